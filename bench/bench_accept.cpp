@@ -0,0 +1,223 @@
+#include <signal.h>
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+struct BenchOption {
+  std::string mode = "batch";
+  std::size_t clients = 16;
+  uint64_t duration_millsec = 3000;
+  std::string output;  // append the json line to this file, empty for stdout
+};
+
+// accepts connections on an edge-triggered listen fd, registers every
+// connection with the loop and closes it at once, so TIME_WAIT stays on the
+// server side and clients never run out of ephemeral ports;
+// "legacy" mode is the former path: accept, setsockopt TCP_NODELAY and
+// SO_KEEPALIVE, fcntl O_NONBLOCK, "batch" mode is accept4 with the flags and
+// options inherited from the listen fd
+class AcceptServer : public PollerEpoll<AcceptServer> {
+ public:
+  AcceptServer(TCPServer& server, const BenchOption& option)
+      : server_(server), legacy_(option.mode == "legacy") {
+    AddRead(server_.FD(), true);
+  }
+
+  void OnRead(int fd) {
+    if (legacy_) {
+      AcceptLegacy();
+      return;
+    }
+    std::size_t n = 0;
+    do {
+      n = server_.AcceptBatch(accepted_);
+      for (auto& connection : accepted_) {
+        Check(connection->FD());
+        AddNonBlockingRead(connection->FD());
+        Remove(connection->FD());
+      }
+      accepted_count_ += n;
+      accepted_.clear();
+    } while (n == TCPServer::max_batch_size_);
+  }
+
+  void OnWrite(int fd) {}
+
+  uint64_t AcceptedCount() const { return accepted_count_; }
+
+ private:
+  void AcceptLegacy() {
+    while (true) {
+      sockaddr_in peer_addr;
+      int conn_fd = socket_accept(server_.FD(), peer_addr);
+      if (conn_fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        printf("failed to accept\n");
+        exit(1);
+      }
+      TCPConnection connection{conn_fd, IPAddr(peer_addr),
+                               IPAddr(peer_addr)};
+      AddRead(conn_fd);
+      Remove(conn_fd);
+      ++accepted_count_;
+    }
+  }
+
+  // accepted fds must come out non-blocking with the listen fd options
+  void Check(int fd) {
+    if (checked_) {
+      return;
+    }
+    checked_ = true;
+    int nodelay = 0;
+    int keepalive = 0;
+    socklen_t len = sizeof(int);
+    ::getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, &len);
+    ::getsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, &len);
+    if (!nodelay || !keepalive || !(::fcntl(fd, F_GETFL) & O_NONBLOCK)) {
+      printf("accepted fd=%d does not inherit the socket options\n", fd);
+      exit(1);
+    }
+  }
+
+ private:
+  TCPServer& server_;
+  bool legacy_ = false;
+  bool checked_ = false;
+  std::vector<std::unique_ptr<TCPConnection>> accepted_;
+  uint64_t accepted_count_ = 0;
+};
+
+// every client thread connects, waits for the server to close and repeats
+void run_client(uint16_t port, const std::atomic<bool>& is_running,
+                std::atomic<std::size_t>& finished) {
+  char buf[16];
+  while (is_running) {
+    TCPClient client{"localhost", port, "localhost", 0};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    while (connection->Recv(buf, sizeof(buf)) > 0) {
+    }
+  }
+  ++finished;
+}
+
+void run_bench(const BenchOption& option) {
+  uint16_t port = get_free_port();
+  TCPServer server{"localhost", port};
+  AcceptServer loop{server, option};
+  std::atomic<bool> is_running = true;
+  std::atomic<std::size_t> finished = 0;
+  std::vector<std::jthread> clients;
+  for (std::size_t i = 0; i < option.clients; ++i) {
+    clients.emplace_back(run_client, port, std::cref(is_running),
+                         std::ref(finished));
+  }
+  auto start = std::chrono::steady_clock::now();
+  loop.RunAfter([&] { loop.Exit(); }, option.duration_millsec);
+  loop.Loop();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  uint64_t accepted = loop.AcceptedCount();
+  // keep accepting until the clients blocked in connect or recv finish their
+  // last round
+  is_running = false;
+  loop.AddTimer(
+      [&] {
+        if (finished == option.clients) {
+          loop.Exit();
+        }
+      },
+      10);
+  loop.Loop();
+  clients.clear();
+
+  FILE* out = stdout;
+  if (!option.output.empty()) {
+    out = ::fopen(option.output.c_str(), "a");
+    if (!out) {
+      printf("failed to open %s\n", option.output.c_str());
+      exit(1);
+    }
+  }
+  fprintf(out,
+          "{\"bench\": \"accept\", \"mode\": \"%s\", \"clients\": %zu, "
+          "\"duration_ms\": %.0f, \"connections\": %lu, "
+          "\"connections_per_sec\": %.0f}\n",
+          option.mode.c_str(), option.clients, seconds * 1000, accepted,
+          accepted / seconds);
+  if (out != stdout) {
+    ::fclose(out);
+  }
+}
+
+inline void print_usage() {
+  printf(
+      "usage: bench_accept [--mode=legacy|batch] [--clients=N] "
+      "[--duration_ms=MS] [--output=FILE]\n");
+  exit(1);
+}
+
+template <typename T>
+void parse_number(std::string_view value, T& result) {
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), result);
+  if (ec != std::errc{} || ptr != value.data() + value.size()) {
+    print_usage();
+  }
+}
+
+inline BenchOption parse_option(int argc, char** argv) {
+  BenchOption option;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto pos = arg.find('=');
+    if (!arg.starts_with("--") || pos == std::string_view::npos) {
+      print_usage();
+    }
+    std::string_view key = arg.substr(2, pos - 2);
+    std::string_view value = arg.substr(pos + 1);
+    if (key == "mode") {
+      option.mode = value;
+    } else if (key == "clients") {
+      parse_number(value, option.clients);
+    } else if (key == "duration_ms") {
+      parse_number(value, option.duration_millsec);
+    } else if (key == "output") {
+      option.output = value;
+    } else {
+      print_usage();
+    }
+  }
+  if ((option.mode != "legacy" && option.mode != "batch") ||
+      option.clients == 0) {
+    print_usage();
+  }
+  return option;
+}
+
+}  // namespace jc
+
+int main(int argc, char** argv) {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::run_bench(jc::parse_option(argc, argv));
+}
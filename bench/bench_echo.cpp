@@ -0,0 +1,263 @@
+#include <signal.h>
+
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "net/fd_table.h"
+#include "net/poller_test.h"
+
+namespace jc {
+
+struct BenchOption {
+  std::string poller = "epoll";
+  std::size_t connections = 64;
+  std::size_t message_size = 64;
+  std::size_t pipeline = 1;
+  uint64_t warmup_millsec = 500;
+  uint64_t duration_millsec = 3000;
+  // both epoll loops spin this long before blocking, see SetBusyPoll
+  uint64_t busy_poll_microsec = 0;
+  std::string output;  // append the json line to this file, empty for stdout
+};
+
+inline uint64_t now_nanosec() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// drives connections against an echo server, every connection keeps
+// pipeline messages in flight and each message carries its send time in the
+// first 8 bytes, the server poller varies while the client always uses epoll
+class BenchClient : public PollerEpoll<BenchClient> {
+ public:
+  BenchClient(uint16_t port, const BenchOption& option)
+      : option_(option), message_(option.message_size, 'x') {
+    SetBusyPoll(option_.busy_poll_microsec);
+    for (std::size_t i = 0; i < option_.connections; ++i) {
+      TCPClient client{"localhost", port, "localhost", 0};
+      auto connection = client.Connect();
+      if (!connection) {
+        exit(1);
+      }
+      int fd = connection->FD();
+      AddRead(fd);
+      connection->SetWriteInterestCallback([this, fd](bool enable) {
+        enable ? SetReadWrite(fd) : SetRead(fd);
+      });
+      sessions_[fd].connection = std::move(connection);
+      fds_.push_back(fd);
+    }
+  }
+
+  void Run() {
+    for (int fd : fds_) {
+      TCPConnection* connection = sessions_[fd].connection.get();
+      for (std::size_t i = 0; i < option_.pipeline; ++i) {
+        SendMessage(connection);
+      }
+    }
+    RunAfter(
+        [this] {
+          histogram_.Reset();
+          messages_ = 0;
+          start_nanosec_ = now_nanosec();
+        },
+        option_.warmup_millsec);
+    RunAfter(
+        [this] {
+          elapsed_nanosec_ = now_nanosec() - start_nanosec_;
+          Exit();
+        },
+        option_.warmup_millsec + option_.duration_millsec);
+    Loop();
+  }
+
+  void OnRead(int fd) {
+    Session* session = sessions_.Find(fd);
+    if (!session || !session->connection) {
+      return;
+    }
+    TCPConnection* connection = session->connection.get();
+    int len = connection->RecvToBuffer();
+    if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (len <= 0) {
+      printf("connection to the echo server is lost\n");
+      exit(1);
+    }
+    Buffer& input = connection->InputBuffer();
+    uint64_t now = now_nanosec();
+    while (input.ReadableBytes() >= option_.message_size) {
+      uint64_t sent_nanosec = 0;
+      std::memcpy(&sent_nanosec, input.Peek(), sizeof(sent_nanosec));
+      histogram_.Record(now - sent_nanosec);
+      ++messages_;
+      input.Retrieve(option_.message_size);
+      SendMessage(connection);
+    }
+  }
+
+  void OnWrite(int fd) {
+    Session* session = sessions_.Find(fd);
+    if (!session || !session->connection) {
+      return;
+    }
+    session->connection->FlushBuffer();
+  }
+
+  void PrintJSON() const {
+    FILE* out = stdout;
+    if (!option_.output.empty()) {
+      out = ::fopen(option_.output.c_str(), "a");
+      if (!out) {
+        printf("failed to open %s\n", option_.output.c_str());
+        exit(1);
+      }
+    }
+    double seconds = elapsed_nanosec_ / 1e9;
+    double messages_per_sec = messages_ / seconds;
+    fprintf(
+        out,
+        "{\"poller\": \"%s\", \"connections\": %zu, \"message_size\": %zu, "
+        "\"pipeline\": %zu, \"busy_poll_us\": %lu, \"duration_ms\": %.0f, "
+        "\"messages\": %lu, "
+        "\"messages_per_sec\": %.0f, \"mb_per_sec\": %.2f, "
+        "\"latency_us\": {\"min\": %.2f, \"mean\": %.2f, \"p50\": %.2f, "
+        "\"p99\": %.2f, \"p999\": %.2f, \"max\": %.2f}}\n",
+        option_.poller.c_str(), option_.connections, option_.message_size,
+        option_.pipeline, option_.busy_poll_microsec, seconds * 1000,
+        messages_, messages_per_sec,
+        messages_per_sec * option_.message_size / (1 << 20),
+        histogram_.Min() / 1e3, histogram_.Mean() / 1e3,
+        histogram_.Percentile(50) / 1e3, histogram_.Percentile(99) / 1e3,
+        histogram_.Percentile(99.9) / 1e3, histogram_.Max() / 1e3);
+    if (out != stdout) {
+      ::fclose(out);
+    }
+  }
+
+ private:
+  void SendMessage(TCPConnection* connection) {
+    uint64_t now = now_nanosec();
+    std::memcpy(message_.data(), &now, sizeof(now));
+    connection->SendBuffered(message_);
+  }
+
+ private:
+  struct Session {
+    std::unique_ptr<TCPConnection> connection;
+  };
+
+ private:
+  const BenchOption& option_;
+  std::string message_;
+  FDTable<Session> sessions_;
+  std::vector<int> fds_;
+  Histogram histogram_;
+  uint64_t messages_ = 0;
+  uint64_t start_nanosec_ = 0;
+  uint64_t elapsed_nanosec_ = 0;
+};
+
+template <template <typename> class Poller>
+void run_bench(const BenchOption& option) {
+  uint16_t port = get_free_port();
+  // bind before the client connects, the server loop outlives the client
+  auto server = std::make_unique<TCPServer>("localhost", port);
+  std::jthread t{[&] {
+    PollerTCPServer<Poller>{
+        std::move(server),
+        option.warmup_millsec + option.duration_millsec + 500,
+        {.echo = true, .busy_poll_microsec = option.busy_poll_microsec}};
+  }};
+  BenchClient client{port, option};
+  client.Run();
+  client.PrintJSON();
+}
+
+inline void print_usage() {
+  printf(
+      "usage: bench_echo [--poller=select|poll|epoll|uring] "
+      "[--connections=N] [--message_size=BYTES] [--pipeline=N] "
+      "[--warmup_ms=MS] [--duration_ms=MS] [--busy_poll_us=US] "
+      "[--output=FILE]\n");
+  exit(1);
+}
+
+template <typename T>
+void parse_number(std::string_view value, T& result) {
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), result);
+  if (ec != std::errc{} || ptr != value.data() + value.size()) {
+    print_usage();
+  }
+}
+
+inline BenchOption parse_option(int argc, char** argv) {
+  BenchOption option;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto pos = arg.find('=');
+    if (!arg.starts_with("--") || pos == std::string_view::npos) {
+      print_usage();
+    }
+    std::string_view key = arg.substr(2, pos - 2);
+    std::string_view value = arg.substr(pos + 1);
+    if (key == "poller") {
+      option.poller = value;
+    } else if (key == "connections") {
+      parse_number(value, option.connections);
+    } else if (key == "message_size") {
+      parse_number(value, option.message_size);
+    } else if (key == "pipeline") {
+      parse_number(value, option.pipeline);
+    } else if (key == "warmup_ms") {
+      parse_number(value, option.warmup_millsec);
+    } else if (key == "duration_ms") {
+      parse_number(value, option.duration_millsec);
+    } else if (key == "busy_poll_us") {
+      parse_number(value, option.busy_poll_microsec);
+    } else if (key == "output") {
+      option.output = value;
+    } else {
+      print_usage();
+    }
+  }
+  // the send time is stamped into every message
+  if (option.message_size < sizeof(uint64_t) || option.connections == 0 ||
+      option.pipeline == 0) {
+    print_usage();
+  }
+  // select cannot watch fds beyond FD_SETSIZE, each connection takes two
+  if (option.poller == "select" && option.connections * 2 + 16 > FD_SETSIZE) {
+    printf("select supports at most %d connections\n", (FD_SETSIZE - 16) / 2);
+    exit(1);
+  }
+  return option;
+}
+
+}  // namespace jc
+
+int main(int argc, char** argv) {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::BenchOption option = jc::parse_option(argc, argv);
+  if (option.poller == "select") {
+    jc::run_bench<jc::PollerSelect>(option);
+  } else if (option.poller == "poll") {
+    jc::run_bench<jc::PollerPoll>(option);
+  } else if (option.poller == "epoll") {
+    jc::run_bench<jc::PollerEpoll>(option);
+  } else if (option.poller == "uring") {
+    jc::run_bench<jc::PollerUring>(option);
+  } else {
+    jc::print_usage();
+  }
+}
@@ -0,0 +1,195 @@
+#include <signal.h>
+
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "net/mailbox.h"
+#include "net/poller_epoll.h"
+
+namespace jc {
+
+struct BenchOption {
+  std::string queue = "mpsc";
+  std::size_t producers = 1;
+  uint64_t messages = 1000000;  // per producer
+  std::size_t capacity = 4096;
+  // pause between posts of one producer, 0 floods the loop and measures
+  // throughput, a pause measures the handoff latency of an idle loop
+  uint64_t interval_microsec = 0;
+  std::string output;  // append the json line to this file, empty for stdout
+};
+
+inline uint64_t now_nanosec() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// producer threads hand their send timestamp to one loop, through a lock-free
+// Mailbox in "spsc" and "mpsc" mode or as a QueueInLoop task in "task_queue"
+// mode; the loop records the handoff latency and exits after the last one
+class EventLoop : public PollerEpoll<EventLoop> {
+ public:
+  explicit EventLoop(uint64_t expected) : expected_(expected) {}
+
+  void OnRead(int fd) { exit(1); }
+  void OnWrite(int fd) { exit(1); }
+
+  void OnMessage(uint64_t sent_nanosec) {
+    histogram_.Record(now_nanosec() - sent_nanosec);
+    if (++received_ == expected_) {
+      Exit();
+    }
+  }
+
+  const Histogram& Latency() const { return histogram_; }
+
+ private:
+  uint64_t expected_ = 0;
+  uint64_t received_ = 0;
+  Histogram histogram_;
+};
+
+template <typename Post>
+void run_producers(const BenchOption& option, Post post) {
+  std::vector<std::jthread> producers;
+  for (std::size_t i = 0; i < option.producers; ++i) {
+    producers.emplace_back([&] {
+      for (uint64_t n = 0; n < option.messages; ++n) {
+        while (!post(now_nanosec())) {
+          std::this_thread::yield();
+        }
+        if (option.interval_microsec != 0) {
+          std::this_thread::sleep_for(
+              std::chrono::microseconds(option.interval_microsec));
+        }
+      }
+    });
+  }
+}
+
+template <template <typename> class Queue>
+void bench_mailbox(const BenchOption& option, EventLoop& loop) {
+  Mailbox<uint64_t, Queue> mailbox{option.capacity};
+  loop.AddMailbox(mailbox,
+                  [&](uint64_t& sent_nanosec) { loop.OnMessage(sent_nanosec); });
+  std::jthread t{[&] {
+    run_producers(option, [&](uint64_t now) { return mailbox.Post(now); });
+  }};
+  loop.Loop();
+  loop.RemoveMailbox(mailbox);
+}
+
+void bench_task_queue(const BenchOption& option, EventLoop& loop) {
+  std::jthread t{[&] {
+    run_producers(option, [&](uint64_t now) {
+      loop.QueueInLoop([&loop, now] { loop.OnMessage(now); });
+      return true;
+    });
+  }};
+  loop.Loop();
+}
+
+void run_bench(const BenchOption& option) {
+  EventLoop loop{option.producers * option.messages};
+  auto start = std::chrono::steady_clock::now();
+  if (option.queue == "spsc") {
+    bench_mailbox<SPSCQueue>(option, loop);
+  } else if (option.queue == "mpsc") {
+    bench_mailbox<MPSCQueue>(option, loop);
+  } else {
+    bench_task_queue(option, loop);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  const Histogram& histogram = loop.Latency();
+
+  FILE* out = stdout;
+  if (!option.output.empty()) {
+    out = ::fopen(option.output.c_str(), "a");
+    if (!out) {
+      printf("failed to open %s\n", option.output.c_str());
+      exit(1);
+    }
+  }
+  fprintf(out,
+          "{\"bench\": \"mailbox\", \"queue\": \"%s\", \"producers\": %zu, "
+          "\"capacity\": %zu, \"interval_us\": %lu, \"duration_ms\": %.0f, "
+          "\"messages\": %lu, \"messages_per_sec\": %.0f, "
+          "\"latency_us\": {\"min\": %.2f, \"mean\": %.2f, \"p50\": %.2f, "
+          "\"p99\": %.2f, \"p999\": %.2f, \"max\": %.2f}}\n",
+          option.queue.c_str(), option.producers, option.capacity,
+          option.interval_microsec, seconds * 1000, histogram.Count(),
+          histogram.Count() / seconds, histogram.Min() / 1e3,
+          histogram.Mean() / 1e3, histogram.Percentile(50) / 1e3,
+          histogram.Percentile(99) / 1e3, histogram.Percentile(99.9) / 1e3,
+          histogram.Max() / 1e3);
+  if (out != stdout) {
+    ::fclose(out);
+  }
+}
+
+inline void print_usage() {
+  printf(
+      "usage: bench_mailbox [--queue=spsc|mpsc|task_queue] [--producers=N] "
+      "[--messages=N] [--capacity=N] [--interval_us=US] [--output=FILE]\n"
+      "spsc takes exactly one producer\n");
+  exit(1);
+}
+
+template <typename T>
+void parse_number(std::string_view value, T& result) {
+  auto [ptr, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), result);
+  if (ec != std::errc{} || ptr != value.data() + value.size()) {
+    print_usage();
+  }
+}
+
+inline BenchOption parse_option(int argc, char** argv) {
+  BenchOption option;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto pos = arg.find('=');
+    if (!arg.starts_with("--") || pos == std::string_view::npos) {
+      print_usage();
+    }
+    std::string_view key = arg.substr(2, pos - 2);
+    std::string_view value = arg.substr(pos + 1);
+    if (key == "queue") {
+      option.queue = value;
+    } else if (key == "producers") {
+      parse_number(value, option.producers);
+    } else if (key == "messages") {
+      parse_number(value, option.messages);
+    } else if (key == "capacity") {
+      parse_number(value, option.capacity);
+    } else if (key == "interval_us") {
+      parse_number(value, option.interval_microsec);
+    } else if (key == "output") {
+      option.output = value;
+    } else {
+      print_usage();
+    }
+  }
+  if ((option.queue != "spsc" && option.queue != "mpsc" &&
+       option.queue != "task_queue") ||
+      option.producers == 0 || option.messages == 0 ||
+      (option.queue == "spsc" && option.producers != 1)) {
+    print_usage();
+  }
+  return option;
+}
+
+}  // namespace jc
+
+int main(int argc, char** argv) {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::run_bench(jc::parse_option(argc, argv));
+}
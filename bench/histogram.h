@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace jc {
+
+// log-linear histogram in the spirit of HdrHistogram, values are grouped by
+// power of two and each group is split into sub_bucket_count_ linear
+// buckets, so any recorded value is reported within 1 / sub_bucket_count_
+// of its real value at a fixed memory cost
+class Histogram {
+ public:
+  static constexpr int sub_bucket_bits_ = 7;
+  static constexpr uint64_t sub_bucket_count_ = uint64_t{1} << sub_bucket_bits_;
+
+  Histogram() : counts_((65 - sub_bucket_bits_) * sub_bucket_count_) {}
+
+  void Record(uint64_t value) {
+    ++counts_[Index(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void Reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = std::numeric_limits<uint64_t>::max();
+    max_ = 0;
+  }
+
+  uint64_t Count() const { return count_; }
+  uint64_t Min() const { return count_ == 0 ? 0 : min_; }
+  uint64_t Max() const { return max_; }
+  double Mean() const { return count_ == 0 ? 0 : 1.0 * sum_ / count_; }
+
+  // the smallest recorded value that percentile percent of values are not
+  // greater than, percentile is in [0, 100]
+  uint64_t Percentile(double percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    auto target = std::max<uint64_t>(
+        1, static_cast<uint64_t>(percentile / 100 * count_ + 0.5));
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < counts_.size(); ++i) {
+      seen += counts_[i];
+      if (seen >= target) {
+        return std::min(HighestEquivalentValue(i), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static std::size_t Index(uint64_t value) {
+    if (value < sub_bucket_count_) {
+      return value;
+    }
+    // group g >= 1 holds the values of bit width g + sub_bucket_bits_ in
+    // buckets 2^(g - 1) wide
+    int group = std::bit_width(value) - sub_bucket_bits_;
+    return group * sub_bucket_count_ + (value >> (group - 1)) -
+           sub_bucket_count_;
+  }
+
+  static uint64_t HighestEquivalentValue(std::size_t index) {
+    uint64_t group = index / sub_bucket_count_;
+    uint64_t sub_bucket = index % sub_bucket_count_;
+    if (group == 0) {
+      return sub_bucket;
+    }
+    int shift = group - 1;
+    return ((sub_bucket + sub_bucket_count_) << shift) +
+           ((uint64_t{1} << shift) - 1);
+  }
+
+ private:
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t min_ = std::numeric_limits<uint64_t>::max();
+  uint64_t max_ = 0;
+};
+
+}  // namespace jc
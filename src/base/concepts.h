@@ -1,6 +1,7 @@
 #pragma once
 
 #include <concepts>
+#include <string_view>
 #include <type_traits>
 
 namespace jc {
@@ -14,4 +15,23 @@ struct is_same_template<T, T> : std::true_type {};
 template <template <typename...> class T, template <typename...> class U>
 concept is_same_template_v = is_same_template<T, U>::value;
 
+// a poller calls OnLoopEnd() once per iteration after every callback ran
+template <typename T>
+concept has_on_loop_end_v = requires(T& t) { t.OnLoopEnd(); };
+
+// PollerEpoll passes EPOLLERR to OnError(fd), e.g. zero-copy completions
+template <typename T>
+concept has_on_error_v = requires(T& t, int fd) { t.OnError(fd); };
+
+// PollerUring passes fds taken by a multishot accept to OnAccept(fd, conn_fd)
+template <typename T>
+concept has_on_accept_v =
+    requires(T& t, int fd, int conn_fd) { t.OnAccept(fd, conn_fd); };
+
+// PollerUring passes data taken by a multishot recv to OnRecv(fd, res, data)
+template <typename T>
+concept has_on_recv_v = requires(T& t, int fd, int res, std::string_view data) {
+  t.OnRecv(fd, res, data);
+};
+
 }  // namespace jc
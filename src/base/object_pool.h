@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// fixed-size slots carved out of slab_size_ slabs and recycled through an
+// intrusive free list, the last freed slot is handed out first so it is
+// likely still in cache; slabs are never returned to malloc because their
+// slots may live on in other threads
+class SlabPool : noncopyable {
+ public:
+  static constexpr std::size_t slab_size_ = 64 * 1024;
+  static constexpr std::size_t alignment_ = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+  explicit constexpr SlabPool(std::size_t slot_size)
+      : slot_size_((std::max(slot_size, sizeof(Slot)) + alignment_ - 1) /
+                   alignment_ * alignment_) {}
+
+  void* Allocate() {
+    if (!free_list_) {
+      Grow();
+    }
+    return std::exchange(free_list_, free_list_->next);
+  }
+
+  void Deallocate(void* p) {
+    free_list_ = new (p) Slot{free_list_};
+  }
+
+ private:
+  struct Slot {
+    Slot* next;
+  };
+
+  void Grow() {
+    std::size_t n = std::max<std::size_t>(slab_size_ / slot_size_, 1);
+    char* slab = static_cast<char*>(::operator new(n * slot_size_));
+    // linked backwards so slots are handed out in address order
+    for (std::size_t i = n; i-- > 0;) {
+      Deallocate(slab + i * slot_size_);
+    }
+  }
+
+ private:
+  std::size_t slot_size_ = 0;
+  Slot* free_list_ = nullptr;
+};
+
+// per-thread slots of sizeof(T), a slot freed by another thread joins the
+// free list of that thread, all slots of one T are interchangeable
+template <typename T>
+class ObjectPool {
+ public:
+  static_assert(alignof(T) <= SlabPool::alignment_);
+
+  static void* Allocate() { return Local().Allocate(); }
+  static void Deallocate(void* p) { Local().Deallocate(p); }
+
+ private:
+  static SlabPool& Local() {
+    thread_local SlabPool pool{sizeof(T)};
+    return pool;
+  }
+};
+
+// per-thread SlabPools in size classes of granularity_ bytes, sizes beyond
+// max_pooled_size_ go to operator new
+class SizeClassPool {
+ public:
+  static constexpr std::size_t granularity_ = 64;
+  static constexpr std::size_t max_pooled_size_ = 4096;
+
+  static void* Allocate(std::size_t size) {
+    if (size > max_pooled_size_) {
+      return ::operator new(size);
+    }
+    return Local()[Index(size)].Allocate();
+  }
+
+  static void Deallocate(void* p, std::size_t size) {
+    if (size > max_pooled_size_) {
+      ::operator delete(p);
+      return;
+    }
+    Local()[Index(size)].Deallocate(p);
+  }
+
+ private:
+  static constexpr std::size_t class_num_ = max_pooled_size_ / granularity_;
+
+  static constexpr std::size_t Index(std::size_t size) {
+    return (std::max<std::size_t>(size, 1) + granularity_ - 1) / granularity_ -
+           1;
+  }
+
+  template <std::size_t... I>
+  static std::array<SlabPool, class_num_> MakePools(
+      std::index_sequence<I...>) {
+    return {SlabPool{(I + 1) * granularity_}...};
+  }
+
+  static std::array<SlabPool, class_num_>& Local() {
+    thread_local std::array<SlabPool, class_num_> pools =
+        MakePools(std::make_index_sequence<class_num_>{});
+    return pools;
+  }
+};
+
+// std allocator over SizeClassPool for the storage of containers
+template <typename T>
+struct PoolAllocator {
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U>
+  constexpr PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    static_assert(alignof(T) <= SlabPool::alignment_);
+    return static_cast<T*>(SizeClassPool::Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    SizeClassPool::Deallocate(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const noexcept {
+    return true;
+  }
+};
+
+}  // namespace jc
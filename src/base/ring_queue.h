@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// bounded lock-free queue for exactly one producer and one consumer thread,
+// capacity is rounded up to a power of two; each side keeps a cached copy
+// of the other index and only reloads it when the ring looks full or empty
+template <typename T>
+class SPSCQueue : noncopyable {
+ public:
+  explicit SPSCQueue(std::size_t capacity)
+      : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+        slots_(std::make_unique<Slot[]>(mask_ + 1)) {}
+
+  ~SPSCQueue() {
+    T value;
+    while (TryPop(value)) {
+    }
+  }
+
+  std::size_t Capacity() const { return mask_ + 1; }
+
+  // producer thread only, false if full
+  template <typename... Args>
+  bool TryEmplace(Args&&... args) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) {
+        return false;
+      }
+    }
+    new (slots_[tail & mask_].storage) T(std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool TryPush(T value) { return TryEmplace(std::move(value)); }
+
+  // consumer thread only, false if empty
+  bool TryPop(T& value) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    T* slot = slots_[head & mask_].Get();
+    value = std::move(*slot);
+    slot->~T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  // producer and consumer indices live on separate cache lines, otherwise
+  // every push invalidates the line the other side is polling
+  static constexpr std::size_t cache_line_size_ = 64;
+
+  struct Slot {
+    alignas(T) std::byte storage[sizeof(T)];
+    T* Get() { return std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+ private:
+  const std::size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  alignas(cache_line_size_) std::atomic<std::size_t> head_ = 0;
+  std::size_t tail_cache_ = 0;  // consumer's view of tail_
+  alignas(cache_line_size_) std::atomic<std::size_t> tail_ = 0;
+  std::size_t head_cache_ = 0;  // producer's view of head_
+  // keeps the next member off the producer line
+  char padding_[cache_line_size_ - sizeof(std::atomic<std::size_t>) -
+                sizeof(std::size_t)];
+};
+
+// bounded lock-free queue for any number of producer threads and one
+// consumer thread, capacity is rounded up to a power of two; every slot
+// carries a sequence number telling producers it is free and the consumer
+// it is published, producers claim slots with one CAS on tail_
+template <typename T>
+class MPSCQueue : noncopyable {
+ public:
+  explicit MPSCQueue(std::size_t capacity)
+      : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+        slots_(std::make_unique<Slot[]>(mask_ + 1)) {
+    for (std::size_t i = 0; i <= mask_; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MPSCQueue() {
+    T value;
+    while (TryPop(value)) {
+    }
+  }
+
+  std::size_t Capacity() const { return mask_ + 1; }
+
+  // thread-safe, false if full
+  template <typename... Args>
+  bool TryEmplace(Args&&... args) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[tail & mask_];
+      const std::size_t seq = slot.seq.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(tail);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed)) {
+          new (slot.storage) T(std::forward<Args>(args)...);
+          slot.seq.store(tail + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // the consumer has not freed the slot of the previous lap
+        return false;
+      } else {
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool TryPush(T value) { return TryEmplace(std::move(value)); }
+
+  // consumer thread only, false if empty or the next slot is claimed but
+  // not published yet
+  bool TryPop(T& value) {
+    Slot& slot = slots_[head_ & mask_];
+    if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+    T* p = slot.Get();
+    value = std::move(*p);
+    p->~T();
+    slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+ private:
+  static constexpr std::size_t cache_line_size_ = 64;
+
+  struct Slot {
+    std::atomic<std::size_t> seq;
+    alignas(T) std::byte storage[sizeof(T)];
+    T* Get() { return std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+ private:
+  const std::size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  alignas(cache_line_size_) std::size_t head_ = 0;  // consumer only
+  alignas(cache_line_size_) std::atomic<std::size_t> tail_ = 0;
+  char padding_[cache_line_size_ - sizeof(std::atomic<std::size_t>)];
+};
+
+}  // namespace jc
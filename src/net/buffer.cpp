@@ -0,0 +1,102 @@
+#include "net/buffer.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace jc {
+
+void Buffer::Retrieve(std::size_t len) {
+  assert(len <= ReadableBytes());
+  if (len < ReadableBytes()) {
+    reader_index_ += len;
+  } else {
+    RetrieveAll();
+  }
+}
+
+void Buffer::RetrieveAll() {
+  reader_index_ = cheap_prepend_;
+  writer_index_ = cheap_prepend_;
+}
+
+std::string Buffer::RetrieveAllAsString() {
+  std::string res{Peek(), ReadableBytes()};
+  RetrieveAll();
+  return res;
+}
+
+void Buffer::Append(const char* data, std::size_t len) {
+  EnsureWritableBytes(len);
+  std::copy_n(data, len, BeginWrite());
+  HasWritten(len);
+}
+
+void Buffer::Prepend(const void* data, std::size_t len) {
+  assert(len <= PrependableBytes());
+  reader_index_ -= len;
+  std::memcpy(buf_.data() + reader_index_, data, len);
+}
+
+void Buffer::EnsureWritableBytes(std::size_t len) {
+  if (WritableBytes() < len) {
+    MakeSpace(len);
+  }
+  assert(WritableBytes() >= len);
+}
+
+void Buffer::Swap(Buffer& rhs) {
+  buf_.swap(rhs.buf_);
+  std::swap(reader_index_, rhs.reader_index_);
+  std::swap(writer_index_, rhs.writer_index_);
+}
+
+ssize_t Buffer::ReadFD(int fd) {
+  char extrabuf[65536];
+  const std::size_t writable = WritableBytes();
+  iovec vec[2];
+  vec[0].iov_base = BeginWrite();
+  vec[0].iov_len = writable;
+  vec[1].iov_base = extrabuf;
+  vec[1].iov_len = sizeof(extrabuf);
+  // skip the spill area once the buffer itself is large enough
+  const int iovcnt = writable < sizeof(extrabuf) ? 2 : 1;
+  const ssize_t n = ::readv(fd, vec, iovcnt);
+  if (n <= 0) {
+    return n;
+  }
+  if (static_cast<std::size_t>(n) <= writable) {
+    HasWritten(n);
+  } else {
+    writer_index_ = buf_.size();
+    Append(extrabuf, n - writable);
+  }
+  return n;
+}
+
+ssize_t Buffer::WriteFD(int fd) {
+  const ssize_t n = ::send(fd, Peek(), ReadableBytes(), MSG_NOSIGNAL);
+  if (n > 0) {
+    Retrieve(n);
+  }
+  return n;
+}
+
+void Buffer::MakeSpace(std::size_t len) {
+  if (WritableBytes() + PrependableBytes() < len + cheap_prepend_) {
+    buf_.resize(writer_index_ + len);
+    return;
+  }
+  // enough room in total, move the readable bytes to the front instead of
+  // growing
+  const std::size_t readable = ReadableBytes();
+  std::copy(buf_.begin() + reader_index_, buf_.begin() + writer_index_,
+            buf_.begin() + cheap_prepend_);
+  reader_index_ = cheap_prepend_;
+  writer_index_ = reader_index_ + readable;
+}
+
+}  // namespace jc
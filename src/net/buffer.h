@@ -0,0 +1,60 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/object_pool.h"
+
+namespace jc {
+
+// +-------------------+------------------+------------------+
+// | prependable bytes |  readable bytes  |  writable bytes  |
+// +-------------------+------------------+------------------+
+// 0           reader_index_     writer_index_         buf_.size()
+class Buffer {
+ public:
+  static constexpr std::size_t cheap_prepend_ = 8;
+  static constexpr std::size_t initial_size_ = 1024;
+
+  explicit Buffer(std::size_t initial_size = initial_size_)
+      : buf_(cheap_prepend_ + initial_size) {}
+
+  std::size_t ReadableBytes() const { return writer_index_ - reader_index_; }
+  std::size_t WritableBytes() const { return buf_.size() - writer_index_; }
+  std::size_t PrependableBytes() const { return reader_index_; }
+  const char* Peek() const { return buf_.data() + reader_index_; }
+  char* BeginWrite() { return buf_.data() + writer_index_; }
+  std::string_view View() const { return {Peek(), ReadableBytes()}; }
+
+  void HasWritten(std::size_t len) { writer_index_ += len; }
+  void Retrieve(std::size_t len);
+  void RetrieveAll();
+  std::string RetrieveAllAsString();
+  void Append(const char* data, std::size_t len);
+  void Append(std::string_view data) { Append(data.data(), data.size()); }
+  void Prepend(const void* data, std::size_t len);
+  void EnsureWritableBytes(std::size_t len);
+  void Swap(Buffer& rhs);
+
+  // drain the fd with one readv, bytes that do not fit the writable space
+  // spill into a 64 KB stack buffer and are appended afterwards, return the
+  // result of readv with errno untouched
+  ssize_t ReadFD(int fd);
+  // send the readable bytes on the socket fd and retrieve what was sent
+  ssize_t WriteFD(int fd);
+
+ private:
+  void MakeSpace(std::size_t len);
+
+ private:
+  // storage of connection-sized buffers is recycled per thread
+  std::vector<char, PoolAllocator<char>> buf_;
+  std::size_t reader_index_ = cheap_prepend_;
+  std::size_t writer_index_ = cheap_prepend_;
+};
+
+}  // namespace jc
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "base/noncopyable.h"
+#include "net/fd_table.h"
+#include "net/ip_addr.h"
+#include "net/resolver.h"
+#include "net/socket_utils.h"
+#include "net/tcp_connection.h"
+
+namespace jc {
+
+struct ConnectorOption {
+  uint64_t timeout_millsec = 3000;  // per attempt
+  uint64_t initial_backoff_millsec = 100;
+  uint64_t max_backoff_millsec = 10000;
+  int max_retries = -1;  // negative retries forever
+};
+
+// non-blocking connect driven by the loop of Poller, an attempt registers
+// the socket for write readiness and reads SO_ERROR once it is reported, a
+// failed or timed out attempt is retried after an exponential backoff; the
+// owner forwards write readiness of FD() to OnWrite(), an owner running many
+// connectors in one loop passes a shared table that maps every attempt's fd
+// to its connector
+template <typename Poller>
+class Connector : noncopyable {
+ public:
+  // receives the connection, or nullptr once max_retries is exhausted
+  using ConnectCallback = std::function<void(std::unique_ptr<TCPConnection>)>;
+
+  Connector(Poller& poller, const IPAddr& peer_addr,
+            const ConnectorOption& option, ConnectCallback f,
+            FDTable<Connector*>* connectors = nullptr)
+      : poller_(poller),
+        peer_addr_(peer_addr),
+        option_(option),
+        connect_callback_(std::move(f)),
+        connectors_(connectors),
+        backoff_millsec_(option.initial_backoff_millsec) {}
+
+  // host is resolved off the loop thread before every attempt, mostly from
+  // the Resolver cache
+  Connector(Poller& poller, std::string_view host, uint16_t port,
+            const ConnectorOption& option, ConnectCallback f,
+            FDTable<Connector*>* connectors = nullptr)
+      : poller_(poller),
+        host_(host),
+        port_(port),
+        option_(option),
+        connect_callback_(std::move(f)),
+        connectors_(connectors),
+        backoff_millsec_(option.initial_backoff_millsec) {}
+
+  ~Connector() { Stop(); }
+
+  // the socket of the attempt in progress, -1 if there is none
+  constexpr int FD() const { return fd_; }
+  constexpr int Attempts() const { return attempts_; }
+
+  void Start() { Connect(); }
+
+  void Stop() {
+    // the worker must not queue the result into a poller that may be gone
+    Resolver::Instance().Cancel(std::exchange(query_, 0));
+    resolving_.reset();
+    if (timer_ != 0) {
+      poller_.CancelTimer(timer_);
+      timer_ = 0;
+    }
+    CloseSocket();
+  }
+
+  void OnWrite() {
+    if (fd_ == -1) {
+      return;
+    }
+    int err = socket_get_error(fd_);
+    sockaddr_in local_addr = socket_local_addr(fd_);
+    // connecting to a local port in the ephemeral range can pick that very
+    // port and connect the socket to itself
+    if (err == 0 && local_addr.sin_port == peer_addr_.SocketAddr().sin_port &&
+        local_addr.sin_addr.s_addr == peer_addr_.SocketAddr().sin_addr.s_addr) {
+      err = ECONNREFUSED;
+    }
+    if (err != 0) {
+      Retry();
+      return;
+    }
+    poller_.CancelTimer(timer_);
+    timer_ = 0;
+    Unregister();
+    connect_callback_(std::make_unique<TCPConnection>(
+        std::exchange(fd_, -1), IPAddr{local_addr}, peer_addr_));
+  }
+
+ private:
+  void Connect() {
+    timer_ = 0;
+    if (host_.empty()) {
+      // an IPAddr built from a name that failed to resolve never connects
+      if (!peer_addr_.IsValid()) {
+        printf("failed to resolve peer addr\n");
+        connect_callback_(nullptr);
+        return;
+      }
+      ConnectAttempt();
+      return;
+    }
+    // a stopped or destroyed connector drops the result
+    resolving_ = std::make_shared<char>();
+    query_ = Resolver::Instance().ResolveInLoop(
+        poller_, host_,
+        [this, resolving = std::weak_ptr<char>(resolving_)](
+            std::optional<in_addr> addr) {
+          if (resolving.expired()) {
+            return;
+          }
+          query_ = 0;
+          resolving_.reset();
+          if (!addr) {
+            printf("failed to resolve: %s\n", host_.c_str());
+            ++attempts_;
+            Retry();
+            return;
+          }
+          peer_addr_ = sockaddr_in{.sin_family = AF_INET,
+                                   .sin_port = ::htons(port_),
+                                   .sin_addr = *addr};
+          ConnectAttempt();
+        });
+  }
+
+  void ConnectAttempt() {
+    ++attempts_;
+    fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   IPPROTO_TCP);
+    if (fd_ == -1) {
+      Retry();
+      return;
+    }
+    if (socket_connect_nonblocking(fd_, peer_addr_.SocketAddr()) == -1 &&
+        errno != EINPROGRESS) {
+      Retry();
+      return;
+    }
+    // a loopback connect may complete at once, write readiness reports both;
+    // a poller returning false cannot watch fd_, e.g. select beyond
+    // FD_SETSIZE, the attempt fails like a refused connect
+    if constexpr (std::is_same_v<decltype(poller_.AddWrite(fd_)), bool>) {
+      if (!poller_.AddWrite(fd_)) {
+        Retry();
+        return;
+      }
+    } else {
+      poller_.AddWrite(fd_);
+    }
+    is_registered_ = true;
+    if (connectors_) {
+      (*connectors_)[fd_] = this;
+    }
+    timer_ = poller_.RunAfter(
+        [this] {
+          timer_ = 0;
+          Retry();
+        },
+        option_.timeout_millsec);
+  }
+
+  void Retry() {
+    Stop();
+    if (option_.max_retries >= 0 && attempts_ > option_.max_retries) {
+      connect_callback_(nullptr);
+      return;
+    }
+    timer_ = poller_.RunAfter([this] { Connect(); }, backoff_millsec_);
+    backoff_millsec_ =
+        std::min(backoff_millsec_ * 2, option_.max_backoff_millsec);
+  }
+
+  void CloseSocket() {
+    if (fd_ == -1) {
+      return;
+    }
+    Unregister();
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  void Unregister() {
+    if (!is_registered_) {
+      return;
+    }
+    poller_.Remove(fd_);
+    if (connectors_) {
+      connectors_->Reset(fd_);
+    }
+    is_registered_ = false;
+  }
+
+ private:
+  Poller& poller_;
+  std::string host_;
+  uint16_t port_ = 0;
+  IPAddr peer_addr_ = {};
+  std::shared_ptr<char> resolving_;
+  Resolver::QueryID query_ = 0;  // lookup in progress on the worker
+  ConnectorOption option_;
+  ConnectCallback connect_callback_;
+  FDTable<Connector*>* connectors_ = nullptr;
+  int fd_ = -1;
+  int attempts_ = 0;
+  bool is_registered_ = false;
+  uint64_t backoff_millsec_ = 0;
+  typename Poller::TimerID timer_ = 0;
+};
+
+}  // namespace jc
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string_view>
+
+#include "base/noncopyable.h"
+#include "base/object_pool.h"
+#include "net/fd_table.h"
+#include "net/poller_epoll.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// a detached coroutine, it starts running at once and frees its frame when
+// it returns, frames are recycled per thread instead of going back to malloc
+class Task {
+ public:
+  struct promise_type {
+    Task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    static void* operator new(std::size_t size) {
+      return SizeClassPool::Allocate(size);
+    }
+    static void operator delete(void* frame, std::size_t size) {
+      SizeClassPool::Deallocate(frame, size);
+    }
+  };
+};
+
+// an operation parked on an fd until the loop reports it ready, OnReady()
+// retries the syscall and returns false to keep waiting on EAGAIN
+class IOAwaiter {
+ public:
+  virtual ~IOAwaiter() = default;
+  virtual bool OnReady() = 0;
+  std::coroutine_handle<> handle_;
+};
+
+// PollerEpoll that resumes coroutines, fds are registered edge-triggered for
+// both directions once, so awaiting costs no epoll_ctl and a coroutine is
+// resumed inline from the dispatch loop; coroutines still suspended when the
+// loop is destroyed are leaked
+class CoroutineLoop : public PollerEpoll<CoroutineLoop> {
+ public:
+  void OnRead(int fd) { Dispatch(waiters_[fd].reader); }
+  void OnWrite(int fd) { Dispatch(waiters_[fd].writer); }
+
+  void Register(int fd) {
+    AddRead(fd, true);
+    SetReadWrite(fd);
+  }
+
+  void Unregister(int fd) {
+    Remove(fd);
+    waiters_.Reset(fd);
+  }
+
+  void WaitRead(int fd, IOAwaiter* awaiter) { waiters_[fd].reader = awaiter; }
+  void WaitWrite(int fd, IOAwaiter* awaiter) { waiters_[fd].writer = awaiter; }
+
+  auto Sleep(uint64_t millsec) {
+    struct Awaiter {
+      CoroutineLoop& loop;
+      uint64_t millsec;
+      bool await_ready() const { return millsec == 0; }
+      void await_suspend(std::coroutine_handle<> handle) {
+        loop.RunAfter([handle] { handle.resume(); }, millsec);
+      }
+      void await_resume() const {}
+    };
+    return Awaiter{*this, millsec};
+  }
+
+ private:
+  static void Dispatch(IOAwaiter*& slot) {
+    if (slot && slot->OnReady()) {
+      std::exchange(slot, nullptr)->handle_.resume();
+    }
+  }
+
+ private:
+  struct Waiters {
+    IOAwaiter* reader = nullptr;
+    IOAwaiter* writer = nullptr;
+  };
+  FDTable<Waiters> waiters_;
+};
+
+// awaitable I/O on a TCPConnection owned by one CoroutineLoop
+class CoroutineConnection : noncopyable {
+ public:
+  CoroutineConnection(CoroutineLoop& loop,
+                      std::unique_ptr<TCPConnection> connection)
+      : loop_(loop), connection_(std::move(connection)) {
+    loop_.Register(connection_->FD());
+  }
+  ~CoroutineConnection() {
+    if (connection_) {
+      loop_.Unregister(connection_->FD());
+    }
+  }
+  CoroutineConnection(CoroutineConnection&& rhs) noexcept
+      : loop_(rhs.loop_), connection_(std::move(rhs.connection_)) {}
+
+  TCPConnection& Connection() { return *connection_; }
+
+  // bytes received, 0 once the peer closed, -1 on error
+  auto Recv(std::span<char> buf) {
+    struct Awaiter : IOAwaiter {
+      CoroutineConnection& self;
+      std::span<char> buf;
+      ssize_t res = -1;
+      Awaiter(CoroutineConnection& self, std::span<char> buf)
+          : self(self), buf(buf) {}
+      bool OnReady() override {
+        res = ::recv(self.connection_->FD(), buf.data(), buf.size(), 0);
+        return res != -1 || (errno != EAGAIN && errno != EWOULDBLOCK);
+      }
+      bool await_ready() { return OnReady(); }
+      void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        self.loop_.WaitRead(self.connection_->FD(), this);
+      }
+      ssize_t await_resume() const { return res; }
+    };
+    return Awaiter{*this, buf};
+  }
+
+  // data.size() once everything is written, -1 on error
+  auto SendAll(std::string_view data) {
+    struct Awaiter : IOAwaiter {
+      CoroutineConnection& self;
+      std::string_view data;
+      std::size_t sent = 0;
+      bool failed = false;
+      Awaiter(CoroutineConnection& self, std::string_view data)
+          : self(self), data(data) {}
+      bool OnReady() override {
+        int n = self.connection_->SendAll(data.data() + sent,
+                                          data.size() - sent);
+        if (n == -1) {
+          failed = true;
+          return true;
+        }
+        sent += n;
+        return sent == data.size();
+      }
+      bool await_ready() { return OnReady(); }
+      void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        self.loop_.WaitWrite(self.connection_->FD(), this);
+      }
+      ssize_t await_resume() const { return failed ? -1 : sent; }
+    };
+    return Awaiter{*this, data};
+  }
+
+ private:
+  CoroutineLoop& loop_;
+  std::unique_ptr<TCPConnection> connection_;
+};
+
+// awaitable accept on a TCPServer owned by one CoroutineLoop
+class CoroutineServer : noncopyable {
+ public:
+  CoroutineServer(CoroutineLoop& loop, std::string_view ip, uint16_t port)
+      : loop_(loop), server_(ip, port) {
+    loop_.Register(server_.FD());
+  }
+  ~CoroutineServer() { loop_.Unregister(server_.FD()); }
+
+  auto Accept() {
+    struct Awaiter : IOAwaiter {
+      CoroutineServer& self;
+      std::unique_ptr<TCPConnection> connection;
+      explicit Awaiter(CoroutineServer& self) : self(self) {}
+      bool OnReady() override {
+        connection = self.server_.Accept();
+        return connection != nullptr;
+      }
+      bool await_ready() { return OnReady(); }
+      void await_suspend(std::coroutine_handle<> handle) {
+        handle_ = handle;
+        self.loop_.WaitRead(self.server_.FD(), this);
+      }
+      CoroutineConnection await_resume() {
+        return {self.loop_, std::move(connection)};
+      }
+    };
+    return Awaiter{*this};
+  }
+
+ private:
+  CoroutineLoop& loop_;
+  TCPServer server_;
+};
+
+}  // namespace jc
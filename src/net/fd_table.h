@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace jc {
+
+// per-fd state stored in a vector indexed by fd, fds are small dense integers
+// so a lookup is one indexed load, the table grows on demand and slots are
+// reset to T{} instead of being erased
+template <typename T>
+class FDTable {
+ public:
+  T& operator[](int fd) {
+    if (static_cast<std::size_t>(fd) >= slots_.size()) {
+      slots_.resize(std::max<std::size_t>(fd + 1, slots_.size() * 2));
+    }
+    return slots_[fd];
+  }
+
+  T* Find(int fd) {
+    return static_cast<std::size_t>(fd) < slots_.size() ? &slots_[fd]
+                                                        : nullptr;
+  }
+
+  const T* Find(int fd) const {
+    return static_cast<std::size_t>(fd) < slots_.size() ? &slots_[fd]
+                                                        : nullptr;
+  }
+
+  void Reset(int fd) {
+    if (T* slot = Find(fd)) {
+      *slot = T{};
+    }
+  }
+
+ private:
+  std::vector<T> slots_;
+};
+
+}  // namespace jc
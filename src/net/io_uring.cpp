@@ -0,0 +1,205 @@
+#include "net/io_uring.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace jc {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* p) {
+  return ::syscall(__NR_io_uring_setup, entries, p);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags, void* arg, std::size_t argsz) {
+  return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+  return ::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+template <typename T>
+T* ring_ptr(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+}  // namespace
+
+IOUring::IOUring(unsigned entries) {
+  io_uring_params p = {};
+  // defer task work to io_uring_enter instead of interrupting the loop
+  p.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+  fd_ = io_uring_setup(entries, &p);
+  if (fd_ == -1 && errno == EINVAL) {  // kernel older than 5.19
+    p = {};
+    fd_ = io_uring_setup(entries, &p);
+  }
+  if (fd_ == -1) {
+    printf("failed to setup io_uring, errno[%d]=%s\n", errno, strerror(errno));
+    exit(1);
+  }
+  features_ = p.features;
+
+  sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  if (HasFeature(IORING_FEAT_SINGLE_MMAP)) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    printf("failed to mmap io_uring sq ring\n");
+    exit(1);
+  }
+  if (HasFeature(IORING_FEAT_SINGLE_MMAP)) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      printf("failed to mmap io_uring cq ring\n");
+      exit(1);
+    }
+  }
+  sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    printf("failed to mmap io_uring sqes\n");
+    exit(1);
+  }
+
+  sq_khead_ = ring_ptr<unsigned>(sq_ring_, p.sq_off.head);
+  sq_ktail_ = ring_ptr<unsigned>(sq_ring_, p.sq_off.tail);
+  sq_array_ = ring_ptr<unsigned>(sq_ring_, p.sq_off.array);
+  sq_mask_ = *ring_ptr<unsigned>(sq_ring_, p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  cq_khead_ = ring_ptr<unsigned>(cq_ring_, p.cq_off.head);
+  cq_ktail_ = ring_ptr<unsigned>(cq_ring_, p.cq_off.tail);
+  cqes_ = ring_ptr<io_uring_cqe>(cq_ring_, p.cq_off.cqes);
+  cq_mask_ = *ring_ptr<unsigned>(cq_ring_, p.cq_off.ring_mask);
+  sqe_tail_ = sqe_head_ = *sq_ktail_;
+}
+
+IOUring::~IOUring() {
+  ::munmap(sqes_, sqes_size_);
+  if (cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  ::munmap(sq_ring_, sq_ring_size_);
+  ::close(fd_);
+  // the kernel unregisters the buffer ring along with the io_uring
+  if (buf_ring_) {
+    ::munmap(buf_ring_, buf_ring_size_);
+  }
+}
+
+io_uring_sqe* IOUring::GetSQE() {
+  unsigned head = std::atomic_ref{*sq_khead_}.load(std::memory_order_acquire);
+  if (sqe_tail_ - head >= sq_entries_) {
+    Submit();
+    head = std::atomic_ref{*sq_khead_}.load(std::memory_order_acquire);
+    if (sqe_tail_ - head >= sq_entries_) {
+      printf("io_uring sq is full\n");
+      exit(1);
+    }
+  }
+  io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+  std::memset(sqe, 0, sizeof(*sqe));
+  ++sqe_tail_;
+  return sqe;
+}
+
+int IOUring::SubmitAndWait(unsigned wait_nr, uint64_t timeout_millsec) {
+  Flush();
+  // an interrupted or partial submit leaves SQEs between the kernel head and
+  // the tail, the kernel submits from its head so they go first
+  unsigned to_submit =
+      sqe_tail_ - std::atomic_ref{*sq_khead_}.load(std::memory_order_acquire);
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  io_uring_getevents_arg arg = {};
+  __kernel_timespec ts = {};
+  void* argp = nullptr;
+  std::size_t argsz = 0;
+  if (wait_nr > 0 && timeout_millsec != 0 &&
+      HasFeature(IORING_FEAT_EXT_ARG)) {
+    ts.tv_sec = timeout_millsec / 1000;
+    ts.tv_nsec = (timeout_millsec % 1000) * 1000000;
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    flags |= IORING_ENTER_EXT_ARG;
+    argp = &arg;
+    argsz = sizeof(arg);
+  }
+  int ret = io_uring_enter(fd_, to_submit, wait_nr, flags, argp, argsz);
+  if (ret == -1) {
+    // interrupted, timed out or the CQ overflowed, completions are reaped by
+    // the caller either way
+    if (errno == EINTR || errno == ETIME || errno == EBUSY ||
+        errno == EAGAIN) {
+      return 0;
+    }
+    printf("failed to io_uring_enter, errno[%d]=%s\n", errno, strerror(errno));
+    exit(1);
+  }
+  return ret;
+}
+
+void IOUring::Flush() {
+  for (; sqe_head_ != sqe_tail_; ++sqe_head_) {
+    sq_array_[sqe_head_ & sq_mask_] = sqe_head_ & sq_mask_;
+  }
+  std::atomic_ref{*sq_ktail_}.store(sqe_tail_, std::memory_order_release);
+}
+
+bool IOUring::SetupBufferRing(unsigned entries, std::size_t buf_size) {
+  buf_ring_size_ = entries * sizeof(io_uring_buf);
+  void* ring = ::mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    return false;
+  }
+  io_uring_buf_reg reg = {};
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = entries;
+  reg.bgid = buffer_group_;
+  if (io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+    ::munmap(ring, buf_ring_size_);
+    return false;
+  }
+  buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+  buf_ring_mask_ = entries - 1;
+  buf_size_ = buf_size;
+  buffers_.resize(entries * buf_size);
+  for (unsigned bid = 0; bid < entries; ++bid) {
+    RecycleBuffer(bid);
+  }
+  return true;
+}
+
+void IOUring::RecycleBuffer(unsigned bid) {
+  // the entries start at the ring itself, the tail overlays the reserved
+  // field of the first one; bufs of the uapi header is misplaced in C++
+  auto* bufs = reinterpret_cast<io_uring_buf*>(buf_ring_);
+  io_uring_buf& buf = bufs[buf_ring_tail_ & buf_ring_mask_];
+  buf.addr = reinterpret_cast<uint64_t>(buffers_.data() + bid * buf_size_);
+  buf.len = buf_size_;
+  buf.bid = bid;
+  ++buf_ring_tail_;
+  std::atomic_ref{buf_ring_->tail}.store(buf_ring_tail_,
+                                         std::memory_order_release);
+}
+
+}  // namespace jc
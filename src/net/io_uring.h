@@ -0,0 +1,103 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// minimal io_uring over the raw syscalls, SQEs are queued with GetSQE and all
+// of them are submitted together with the wait for completions in one
+// io_uring_enter
+class IOUring : noncopyable {
+ public:
+  explicit IOUring(unsigned entries = 256);
+  ~IOUring();
+  constexpr int FD() const { return fd_; }
+  constexpr bool HasFeature(unsigned feature) const {
+    return features_ & feature;
+  }
+
+  // return a zeroed SQE, queued SQEs are submitted first if the SQ is full
+  io_uring_sqe* GetSQE();
+  // submit the queued SQEs and wait for at least wait_nr completions, a
+  // timeout of 0 waits forever, return the number of SQEs submitted
+  int SubmitAndWait(unsigned wait_nr, uint64_t timeout_millsec = 0);
+  int Submit() { return SubmitAndWait(0); }
+
+  // register entries provided buffers of buf_size bytes as buffer_group_,
+  // SQEs with IOSQE_BUFFER_SELECT then let the kernel pick one per
+  // completion; entries is a power of two, false if the kernel lacks
+  // IORING_REGISTER_PBUF_RING (5.19)
+  bool SetupBufferRing(unsigned entries, std::size_t buf_size);
+  bool HasBufferRing() const { return buf_ring_ != nullptr; }
+  // len bytes the kernel wrote to buffer bid
+  std::string_view BufferData(unsigned bid, std::size_t len) const {
+    return {buffers_.data() + bid * buf_size_, len};
+  }
+  // hand buffer bid back to the kernel once its data is consumed
+  void RecycleBuffer(unsigned bid);
+
+  static constexpr uint16_t buffer_group_ = 0;
+
+  // call f for every available CQE and mark them consumed
+  template <typename F>
+  void ForEachCQE(F&& f);
+
+ private:
+  void Flush();
+
+ private:
+  int fd_ = -1;
+  unsigned features_ = 0;
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  std::size_t sq_ring_size_ = 0;
+  std::size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+
+  unsigned* sq_khead_ = nullptr;
+  unsigned* sq_ktail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned sqe_tail_ = 0;  // SQEs handed out by GetSQE
+  unsigned sqe_head_ = 0;  // SQEs published to the kernel
+
+  unsigned* cq_khead_ = nullptr;
+  unsigned* cq_ktail_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  unsigned cq_mask_ = 0;
+
+  io_uring_buf_ring* buf_ring_ = nullptr;
+  std::size_t buf_ring_size_ = 0;
+  uint16_t buf_ring_mask_ = 0;
+  uint16_t buf_ring_tail_ = 0;
+  std::size_t buf_size_ = 0;
+  std::vector<char> buffers_;
+};
+
+template <typename F>
+inline void IOUring::ForEachCQE(F&& f) {
+  unsigned head = *cq_khead_;
+  // callbacks may queue new SQEs but never reap completions, so the tail is
+  // re-read until the CQ is drained
+  while (true) {
+    unsigned tail = std::atomic_ref{*cq_ktail_}.load(std::memory_order_acquire);
+    if (head == tail) {
+      break;
+    }
+    for (; head != tail; ++head) {
+      f(cqes_[head & cq_mask_]);
+    }
+    std::atomic_ref{*cq_khead_}.store(head, std::memory_order_release);
+  }
+}
+
+}  // namespace jc
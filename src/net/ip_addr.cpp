@@ -5,7 +5,7 @@
 namespace jc {
 
 IPAddr::IPAddr(std::string_view ip, uint16_t port)
-    : addr_(resolve_socketaddr(ip, port)) {}
+    : addr_(resolve_socketaddr(ip, port).value_or(sockaddr_in{})) {}
 
 std::string IPAddr::IP() const { return sockaddr_to_ip(addr_); }
 
@@ -10,8 +10,11 @@ class IPAddr {
  public:
   constexpr IPAddr() = default;
   constexpr IPAddr(const sockaddr_in& addr) : addr_(addr) {}
+  // resolves ip through Resolver, blocking on a cache miss, the address is
+  // left invalid if ip cannot be resolved
   IPAddr(std::string_view ip, uint16_t port);
   constexpr const sockaddr_in& SocketAddr() const { return addr_; }
+  constexpr bool IsValid() const { return addr_.sin_family == AF_INET; }
 
   std::string IP() const;
   uint16_t Port() const;
@@ -0,0 +1,125 @@
+#include "net/length_codec.h"
+
+#include <cassert>
+
+namespace jc {
+
+namespace {
+
+// the largest length each field can encode, Varint keeps 7 bits per byte
+constexpr std::size_t max_field_length(LengthField length_field) {
+  switch (length_field) {
+    case LengthField::Fixed16:
+      return UINT16_MAX;
+    case LengthField::Fixed32:
+      return UINT32_MAX;
+    case LengthField::Varint:
+      return (std::size_t{1} << (7 * LengthCodec::max_varint_size_)) - 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+LengthCodec::LengthCodec(const LengthCodecOption& option) : option_(option) {
+  assert(option_.length_field != LengthField::Fixed16 ||
+         option_.max_frame_size <= UINT16_MAX);
+}
+
+bool LengthCodec::Decode(Buffer& buffer, const FramesCallback& f) {
+  frames_.clear();
+  std::string_view data = buffer.View();
+  std::size_t consumed = 0;
+  bool ok = true;
+  while (true) {
+    std::size_t len = 0;
+    int header_size = ParseHeader(data.substr(consumed), len);
+    if (header_size == -1) {
+      ok = false;
+      break;
+    }
+    if (header_size == 0 || data.size() - consumed < header_size + len) {
+      break;
+    }
+    frames_.emplace_back(data.substr(consumed + header_size, len));
+    consumed += header_size + len;
+  }
+  if (!frames_.empty()) {
+    f(frames_);
+  }
+  buffer.Retrieve(consumed);
+  return ok;
+}
+
+bool LengthCodec::Encode(std::string_view payload, Buffer& out) const {
+  std::size_t len = payload.size();
+  if (len > option_.max_frame_size ||
+      len > max_field_length(option_.length_field)) {
+    return false;
+  }
+  uint8_t header[max_varint_size_];
+  std::size_t header_size = 0;
+  switch (option_.length_field) {
+    case LengthField::Fixed16:
+      header[header_size++] = static_cast<uint8_t>(len >> 8);
+      header[header_size++] = static_cast<uint8_t>(len);
+      break;
+    case LengthField::Fixed32:
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        header[header_size++] = static_cast<uint8_t>(len >> shift);
+      }
+      break;
+    case LengthField::Varint:
+      while (len >= 0x80) {
+        header[header_size++] = static_cast<uint8_t>(len | 0x80);
+        len >>= 7;
+      }
+      header[header_size++] = static_cast<uint8_t>(len);
+      break;
+  }
+  out.EnsureWritableBytes(header_size + payload.size());
+  out.Append(reinterpret_cast<const char*>(header), header_size);
+  out.Append(payload);
+  return true;
+}
+
+int LengthCodec::ParseHeader(std::string_view data, std::size_t& len) const {
+  auto byte = [&](std::size_t i) { return static_cast<uint8_t>(data[i]); };
+  int header_size = 0;
+  switch (option_.length_field) {
+    case LengthField::Fixed16:
+      if (data.size() < 2) {
+        return 0;
+      }
+      len = byte(0) << 8 | byte(1);
+      header_size = 2;
+      break;
+    case LengthField::Fixed32:
+      if (data.size() < 4) {
+        return 0;
+      }
+      len = static_cast<std::size_t>(byte(0)) << 24 | byte(1) << 16 |
+            byte(2) << 8 | byte(3);
+      header_size = 4;
+      break;
+    case LengthField::Varint:
+      len = 0;
+      for (std::size_t i = 0;; ++i) {
+        if (i == max_varint_size_) {
+          return -1;
+        }
+        if (i == data.size()) {
+          return 0;
+        }
+        len |= static_cast<std::size_t>(byte(i) & 0x7f) << (7 * i);
+        if (!(byte(i) & 0x80)) {
+          header_size = i + 1;
+          break;
+        }
+      }
+      break;
+  }
+  return len > option_.max_frame_size ? -1 : header_size;
+}
+
+}  // namespace jc
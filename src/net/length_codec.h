@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "net/buffer.h"
+
+namespace jc {
+
+// Fixed16 and Fixed32 are big-endian, Varint is LEB128 of at most 5 bytes
+enum class LengthField { Fixed16, Fixed32, Varint };
+
+struct LengthCodecOption {
+  LengthField length_field = LengthField::Fixed32;
+  std::size_t max_frame_size = 1 << 20;  // payload bytes, header excluded
+};
+
+// frames are a length field followed by that many payload bytes, Decode()
+// hands every complete frame in the buffer to one callback as views into the
+// buffer, the views are only valid during the callback
+class LengthCodec {
+ public:
+  using FramesCallback = std::function<void(std::span<const std::string_view>)>;
+
+  static constexpr std::size_t max_varint_size_ = 5;
+
+  explicit LengthCodec(const LengthCodecOption& option = {});
+
+  // retrieve the complete frames from buffer after f returns, an incomplete
+  // tail is left for the next read; return false on a frame larger than
+  // max_frame_size or a malformed varint, the stream cannot be resynced
+  bool Decode(Buffer& buffer, const FramesCallback& f);
+  // append the length field and payload to out; return false and leave out
+  // untouched if payload is larger than max_frame_size or than the length
+  // field can hold, the peer's Decode() would reject or misread it
+  bool Encode(std::string_view payload, Buffer& out) const;
+
+ private:
+  // 0 if the length field is incomplete, -1 if it is invalid, otherwise the
+  // header size with the payload size stored in len
+  int ParseHeader(std::string_view data, std::size_t& len) const;
+
+ private:
+  LengthCodecOption option_;
+  std::vector<std::string_view> frames_;  // reused across reads
+};
+
+}  // namespace jc
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#include "base/noncopyable.h"
+#include "base/ring_queue.h"
+
+namespace jc {
+
+// messages of type T posted to an event loop from other threads without a
+// lock, the loop registers it with AddMailbox() and drains it on wakeup;
+// Queue is MPSCQueue for any number of senders or SPSCQueue when exactly one
+// thread posts. Like TaskQueue the eventfd is only written when the loop is
+// not already notified, a burst of posts costs one wakeup
+template <typename T, template <typename> class Queue = MPSCQueue>
+class Mailbox : noncopyable {
+ public:
+  explicit Mailbox(std::size_t capacity) : queue_(capacity) {
+    efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd_ == -1) {
+      printf("failed to create eventfd\n");
+      exit(1);
+    }
+  }
+
+  ~Mailbox() { ::close(efd_); }
+
+  constexpr int FD() const { return efd_; }
+  std::size_t Capacity() const { return queue_.Capacity(); }
+
+  // thread-safe for MPSCQueue, false if full, the caller decides whether to
+  // retry, drop or fall back to QueueInLoop
+  bool Post(T message) {
+    if (!queue_.TryPush(std::move(message))) {
+      return false;
+    }
+    if (!is_notified_.exchange(true)) {
+      Wakeup();
+    }
+    return true;
+  }
+
+  // loop thread only, run f(T&) for at most Capacity() messages so a flood of
+  // posts cannot starve the other fds, what is left wakes the loop again;
+  // return the number of messages
+  template <typename F>
+  std::size_t Drain(F&& f) {
+    uint64_t howmany;
+    [[maybe_unused]] ssize_t n = ::read(efd_, &howmany, sizeof(howmany));
+    // a post that finds the flag cleared writes the eventfd again, the fence
+    // keeps the pops below from being ordered before the clear
+    is_notified_.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::size_t messages = 0;
+    T message;
+    while (messages < queue_.Capacity() && queue_.TryPop(message)) {
+      f(message);
+      ++messages;
+    }
+    if (messages == queue_.Capacity() && !is_notified_.exchange(true)) {
+      Wakeup();
+    }
+    return messages;
+  }
+
+ private:
+  void Wakeup() const {
+    uint64_t one = 1;
+    if (::write(efd_, &one, sizeof(one)) != sizeof(one)) {
+      printf("write eventfd error\n");
+    }
+  }
+
+ private:
+  int efd_ = -1;
+  Queue<T> queue_;
+  std::atomic<bool> is_notified_ = false;
+};
+
+}  // namespace jc
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace jc {
+
+// event loop and connection telemetry, compiled in with -DSNET_METRICS
+// (make METRICS=1) for the library and its users alike since it changes the
+// layout of TCPConnection; without it every hook is an empty inline call
+
+#ifdef SNET_METRICS
+
+// written by one thread, read from any thread without locks
+class Counter {
+ public:
+  void Add(uint64_t n) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+  void Set(uint64_t n) { value_.store(n, std::memory_order_relaxed); }
+  uint64_t Get() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_ = 0;
+};
+
+// power-of-two buckets, bucket i counts values in [2^(i-1), 2^i), written by
+// one thread and read from any thread without locks
+class Log2Histogram {
+ public:
+  static constexpr int bucket_num_ = 65;
+
+  void Record(uint64_t value) {
+    buckets_[std::bit_width(value)].Add(1);
+    count_.Add(1);
+    sum_.Add(value);
+    if (value > max_.Get()) {
+      max_.Set(value);
+    }
+  }
+
+  uint64_t Count() const { return count_.Get(); }
+  uint64_t Sum() const { return sum_.Get(); }
+  uint64_t Max() const { return max_.Get(); }
+  uint64_t Bucket(int i) const { return buckets_[i].Get(); }
+  static constexpr uint64_t UpperBound(int i) {
+    return i == 0 ? 0 : i == 64 ? UINT64_MAX : (uint64_t{1} << i) - 1;
+  }
+
+  // the upper bound of the bucket holding the percentile
+  uint64_t Percentile(double percentile) const {
+    uint64_t count = Count();
+    uint64_t target = static_cast<uint64_t>(percentile / 100 * count + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_num_; ++i) {
+      seen += Bucket(i);
+      if (seen >= target && seen != 0) {
+        return std::min(UpperBound(i), Max());
+      }
+    }
+    return Max();
+  }
+
+  void AppendJSON(std::string& out) const {
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "{\"count\": %lu, \"sum\": %lu, \"max\": %lu, \"p50\": %lu, "
+             "\"p99\": %lu}",
+             Count(), Sum(), Max(), Percentile(50), Percentile(99));
+    out += buf;
+  }
+
+  // cumulative buckets up to the highest non-empty one
+  void AppendPrometheus(std::string& out, std::string_view name,
+                        std::string_view labels) const {
+    char buf[256];
+    int last = bucket_num_ - 1;
+    while (last > 0 && Bucket(last) == 0) {
+      --last;
+    }
+    snprintf(buf, sizeof(buf), "# TYPE %.*s histogram\n",
+             static_cast<int>(name.size()), name.data());
+    out += buf;
+    uint64_t cumulative = 0;
+    for (int i = 0; i <= last && i < 64; ++i) {
+      cumulative += Bucket(i);
+      snprintf(buf, sizeof(buf), "%.*s_bucket{%.*s%sle=\"%lu\"} %lu\n",
+               static_cast<int>(name.size()), name.data(),
+               static_cast<int>(labels.size()), labels.data(),
+               labels.empty() ? "" : ",", UpperBound(i), cumulative);
+      out += buf;
+    }
+    snprintf(buf, sizeof(buf),
+             "%.*s_bucket{%.*s%sle=\"+Inf\"} %lu\n%.*s_sum{%.*s} %lu\n"
+             "%.*s_count{%.*s} %lu\n",
+             static_cast<int>(name.size()), name.data(),
+             static_cast<int>(labels.size()), labels.data(),
+             labels.empty() ? "" : ",", Count(),
+             static_cast<int>(name.size()), name.data(),
+             static_cast<int>(labels.size()), labels.data(), Sum(),
+             static_cast<int>(name.size()), name.data(),
+             static_cast<int>(labels.size()), labels.data(), Count());
+    out += buf;
+  }
+
+ private:
+  Counter buckets_[bucket_num_];
+  Counter count_;
+  Counter sum_;
+  Counter max_;
+};
+
+class LoopMetrics {
+ public:
+  static constexpr bool enabled_ = true;
+
+  static uint64_t Now() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * uint64_t{1000000000} + ts.tv_nsec;
+  }
+
+  void OnWakeup(int events) {
+    wakeups_.Add(1);
+    events_per_wakeup_.Record(events);
+  }
+  void OnDispatched(uint64_t start) {
+    dispatch_nanosec_.Record(Now() - start);
+  }
+  void OnCallback(uint64_t start) { callback_nanosec_.Record(Now() - start); }
+  void OnTimer(uint64_t lag_nanosec, std::size_t timers) {
+    timer_lag_nanosec_.Record(lag_nanosec);
+    timers_.Set(timers);
+  }
+  void OnTasks(std::size_t tasks) { task_queue_depth_.Record(tasks); }
+  void OnMailbox(std::size_t messages) { mailbox_batch_.Record(messages); }
+  void OnEventArrayResized() { event_array_resizes_.Add(1); }
+  // a busy-polling loop found events while spinning, or slept in the kernel
+  void OnBusyPollHit() { busy_poll_hits_.Add(1); }
+  void OnBlockingWait() { blocking_waits_.Add(1); }
+
+  std::string ToJSON() const {
+    std::string out;
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "{\"wakeups\": %lu, \"event_array_resizes\": %lu, "
+             "\"busy_poll_hits\": %lu, \"blocking_waits\": %lu, "
+             "\"timers\": %lu",
+             wakeups_.Get(), event_array_resizes_.Get(),
+             busy_poll_hits_.Get(), blocking_waits_.Get(), timers_.Get());
+    out += buf;
+    for (auto [name, histogram] : Histograms()) {
+      out += ", \"";
+      out += name;
+      out += "\": ";
+      histogram->AppendJSON(out);
+    }
+    out += "}";
+    return out;
+  }
+
+  // labels such as loop="0" are attached to every sample
+  std::string ToPrometheus(std::string_view labels = {}) const {
+    std::string out;
+    char buf[256];
+    for (auto [name, counter] :
+         {std::pair{"snet_loop_wakeups_total", &wakeups_},
+          std::pair{"snet_loop_event_array_resizes_total",
+                    &event_array_resizes_},
+          std::pair{"snet_loop_busy_poll_hits_total", &busy_poll_hits_},
+          std::pair{"snet_loop_blocking_waits_total", &blocking_waits_}}) {
+      snprintf(buf, sizeof(buf), "# TYPE %s counter\n%s{%.*s} %lu\n", name,
+               name, static_cast<int>(labels.size()), labels.data(),
+               counter->Get());
+      out += buf;
+    }
+    snprintf(buf, sizeof(buf),
+             "# TYPE snet_loop_timers gauge\nsnet_loop_timers{%.*s} %lu\n",
+             static_cast<int>(labels.size()), labels.data(), timers_.Get());
+    out += buf;
+    for (auto [name, histogram] : Histograms()) {
+      histogram->AppendPrometheus(out, std::string{"snet_loop_"} + name,
+                                  labels);
+    }
+    return out;
+  }
+
+ private:
+  using Entry = std::pair<const char*, const Log2Histogram*>;
+
+  std::array<Entry, 6> Histograms() const {
+    return {
+        Entry{"events_per_wakeup", &events_per_wakeup_},
+        Entry{"task_queue_depth", &task_queue_depth_},
+        Entry{"mailbox_batch", &mailbox_batch_},
+        Entry{"dispatch_nanosec", &dispatch_nanosec_},
+        Entry{"callback_nanosec", &callback_nanosec_},
+        Entry{"timer_lag_nanosec", &timer_lag_nanosec_}};
+  }
+
+ private:
+  Counter wakeups_;
+  Counter event_array_resizes_;
+  Counter busy_poll_hits_;
+  Counter blocking_waits_;
+  Counter timers_;  // pending timers after the last expiry
+  Log2Histogram events_per_wakeup_;
+  Log2Histogram task_queue_depth_;  // tasks run per wakeup
+  Log2Histogram mailbox_batch_;     // messages drained per wakeup
+  Log2Histogram dispatch_nanosec_;  // all callbacks of one wakeup
+  Log2Histogram callback_nanosec_;  // OnRead and OnWrite of one fd
+  Log2Histogram timer_lag_nanosec_;
+};
+
+class ConnectionMetrics {
+ public:
+  static constexpr bool enabled_ = true;
+
+  // n is the syscall result, errors count as a syscall without bytes
+  void OnRecv(ssize_t n) {
+    recv_syscalls_.Add(1);
+    bytes_received_.Add(n > 0 ? n : 0);
+  }
+  void OnSend(ssize_t n, std::size_t syscalls = 1) {
+    send_syscalls_.Add(syscalls);
+    bytes_sent_.Add(n > 0 ? n : 0);
+  }
+
+  uint64_t BytesReceived() const { return bytes_received_.Get(); }
+  uint64_t BytesSent() const { return bytes_sent_.Get(); }
+  uint64_t RecvSyscalls() const { return recv_syscalls_.Get(); }
+  uint64_t SendSyscalls() const { return send_syscalls_.Get(); }
+
+  std::string ToJSON() const {
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "{\"bytes_received\": %lu, \"bytes_sent\": %lu, "
+             "\"recv_syscalls\": %lu, \"send_syscalls\": %lu}",
+             BytesReceived(), BytesSent(), RecvSyscalls(), SendSyscalls());
+    return buf;
+  }
+
+ private:
+  Counter bytes_received_;
+  Counter bytes_sent_;
+  Counter recv_syscalls_;
+  Counter send_syscalls_;
+};
+
+#else
+
+class LoopMetrics {
+ public:
+  static constexpr bool enabled_ = false;
+
+  static constexpr uint64_t Now() { return 0; }
+  void OnWakeup(int) {}
+  void OnDispatched(uint64_t) {}
+  void OnCallback(uint64_t) {}
+  void OnTimer(uint64_t, std::size_t) {}
+  void OnTasks(std::size_t) {}
+  void OnMailbox(std::size_t) {}
+  void OnEventArrayResized() {}
+  void OnBusyPollHit() {}
+  void OnBlockingWait() {}
+  std::string ToJSON() const { return "{}"; }
+  std::string ToPrometheus(std::string_view = {}) const { return {}; }
+};
+
+class ConnectionMetrics {
+ public:
+  static constexpr bool enabled_ = false;
+
+  void OnRecv(ssize_t) {}
+  void OnSend(ssize_t, std::size_t = 1) {}
+  uint64_t BytesReceived() const { return 0; }
+  uint64_t BytesSent() const { return 0; }
+  uint64_t RecvSyscalls() const { return 0; }
+  uint64_t SendSyscalls() const { return 0; }
+  std::string ToJSON() const { return "{}"; }
+};
+
+#endif
+
+}  // namespace jc
@@ -0,0 +1,239 @@
+#include "net/output_queue.h"
+
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "net/socket_utils.h"
+
+namespace jc {
+
+OutputQueue::~OutputQueue() {
+  for (Chunk& chunk : chunks_) {
+    if (chunk.IsZeroCopy()) {
+      chunk.zerocopy.release();
+    }
+  }
+  for (InFlight& in_flight : in_flight_) {
+    in_flight.release();
+  }
+}
+
+void OutputQueue::Append(std::string_view data) {
+  size_ += data.size();
+  if (!chunks_.empty() && chunks_.back().IsBytes()) {
+    Buffer& tail = chunks_.back().buffer;
+    std::size_t n = std::min(tail.WritableBytes(), data.size());
+    tail.Append(data.data(), n);
+    data.remove_prefix(n);
+  }
+  if (!data.empty()) {
+    chunks_.push_back({.buffer = Buffer{std::max(chunk_size_, data.size())}});
+    chunks_.back().buffer.Append(data);
+  }
+}
+
+void OutputQueue::AppendFile(int fd, off_t offset, std::size_t len) {
+  if (len == 0) {
+    return;
+  }
+  size_ += len;
+  chunks_.push_back(
+      {.buffer = Buffer{0}, .transfer = {.fd = fd, .offset = offset, .len = len}});
+}
+
+void OutputQueue::AppendPipe(int pipe_fd, std::size_t len) {
+  if (len == 0) {
+    return;
+  }
+  size_ += len;
+  chunks_.push_back({.buffer = Buffer{0},
+                     .transfer = {.fd = pipe_fd, .len = len, .is_pipe = true}});
+}
+
+void OutputQueue::AppendZeroCopy(std::string_view data,
+                                 std::function<void()> release) {
+  if (data.empty()) {
+    release();
+    return;
+  }
+  size_ += data.size();
+  chunks_.push_back(
+      {.buffer = Buffer{0},
+       .zerocopy = {.data = data.data(),
+                    .len = data.size(),
+                    .release = std::move(release)}});
+}
+
+std::size_t OutputQueue::ReapZeroCopy(int fd, bool* copied) {
+  std::size_t released = 0;
+  while (true) {
+    char control[128];
+    msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    // never blocks, EAGAIN once the error queue is drained
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+      break;
+    }
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      const auto* err =
+          reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      if (copied && (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)) {
+        *copied = true;
+      }
+      // sends [ee_info, ee_data] are complete, TCP completes them in order,
+      // the comparison survives the wrap of the 32-bit counter
+      while (!in_flight_.empty() &&
+             static_cast<int32_t>(in_flight_.front().seq - err->ee_data) <=
+                 0) {
+        std::function<void()> release = std::move(in_flight_.front().release);
+        in_flight_.pop_front();
+        release();
+        ++released;
+      }
+    }
+  }
+  return released;
+}
+
+ssize_t OutputQueue::WriteFD(int fd, std::size_t* syscalls) {
+  ssize_t sent = 0;
+  while (!Empty()) {
+    const Chunk& front = chunks_.front();
+    ssize_t n = front.IsTransfer()   ? WriteTransfer(fd)
+                : front.IsZeroCopy() ? WriteZeroCopy(fd)
+                                     : WriteBuffers(fd);
+    if (syscalls) {
+      ++*syscalls;
+    }
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return -1;
+    }
+    sent += n;
+  }
+  // a transfer that wrote nothing, e.g. a file shorter than requested, may
+  // leave the queue empty behind bytes corked for it
+  if (Empty() && is_corked_) {
+    socket_push_pending(fd);
+    is_corked_ = false;
+    if (syscalls) {
+      ++*syscalls;
+    }
+  }
+  return sent;
+}
+
+ssize_t OutputQueue::WriteBuffers(int fd) {
+  iovec iovs[max_iovecs_];
+  std::size_t iovcnt = 0;
+  auto it = chunks_.begin();
+  for (; it != chunks_.end() && it->IsBytes() && iovcnt < max_iovecs_; ++it) {
+    iovs[iovcnt++] = {.iov_base = const_cast<char*>(it->buffer.Peek()),
+                      .iov_len = it->buffer.ReadableBytes()};
+  }
+  // writev with MSG_NOSIGNAL, a closed peer is reported as EPIPE; MSG_MORE
+  // corks the tail while more chunks follow, e.g. a header before sendfile,
+  // the last write of the queue uncorks or WriteFD() pushes the tail
+  msghdr msg = {};
+  msg.msg_iov = iovs;
+  msg.msg_iovlen = iovcnt;
+  const bool is_more = it != chunks_.end();
+  ssize_t n =
+      ::sendmsg(fd, &msg, is_more ? MSG_NOSIGNAL | MSG_MORE : MSG_NOSIGNAL);
+  if (n <= 0) {
+    return n;
+  }
+  is_corked_ = is_more;
+  size_ -= n;
+  std::size_t left = n;
+  while (left > 0) {
+    Buffer& buffer = chunks_.front().buffer;
+    if (left < buffer.ReadableBytes()) {
+      buffer.Retrieve(left);
+      break;
+    }
+    left -= buffer.ReadableBytes();
+    chunks_.pop_front();
+  }
+  return n;
+}
+
+ssize_t OutputQueue::WriteTransfer(int fd) {
+  Transfer& transfer = chunks_.front().transfer;
+  ssize_t n = transfer.is_pipe
+                  ? ::splice(transfer.fd, nullptr, fd, nullptr, transfer.len,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK)
+                  : ::sendfile(fd, transfer.fd, &transfer.offset, transfer.len);
+  if (n == -1) {
+    return -1;
+  }
+  if (n == 0) {
+    // the file is shorter than requested or the pipe writer is gone
+    size_ -= transfer.len;
+    chunks_.pop_front();
+    return 0;
+  }
+  is_corked_ = false;
+  size_ -= n;
+  transfer.len -= n;
+  if (transfer.len == 0) {
+    chunks_.pop_front();
+  }
+  return n;
+}
+
+ssize_t OutputQueue::WriteZeroCopy(int fd) {
+  ZeroCopy& zerocopy = chunks_.front().zerocopy;
+  ssize_t n =
+      ::send(fd, zerocopy.data, zerocopy.len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+  if (n > 0) {
+    zerocopy.has_seq = true;
+    zerocopy.last_seq = next_seq_++;
+  } else if (n == -1 && errno == ENOBUFS) {
+    // out of option memory to pin pages or queue the completion, copy
+    n = ::send(fd, zerocopy.data, zerocopy.len, MSG_NOSIGNAL);
+  }
+  if (n <= 0) {
+    return n;
+  }
+  is_corked_ = false;
+  size_ -= n;
+  zerocopy.data += n;
+  zerocopy.len -= n;
+  if (zerocopy.len == 0) {
+    // a payload copied as a whole is done at once
+    std::function<void()> release = std::move(zerocopy.release);
+    if (zerocopy.has_seq) {
+      in_flight_.push_back({.seq = zerocopy.last_seq,
+                            .release = std::move(release)});
+      chunks_.pop_front();
+    } else {
+      chunks_.pop_front();
+      release();
+    }
+  }
+  return n;
+}
+
+}  // namespace jc
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <deque>
+#include <functional>
+#include <string_view>
+
+#include "base/object_pool.h"
+#include "net/buffer.h"
+
+namespace jc {
+
+// pending output of a connection as a chain of chunks, appended bytes are
+// packed into chunks of chunk_size_ that are gathered into one sendmsg, and
+// sendfile or splice transfers and zero-copy payloads keep their place
+// between the bytes
+class OutputQueue {
+ public:
+  static constexpr std::size_t chunk_size_ = 16 * 1024;
+  static constexpr std::size_t max_iovecs_ = 64;
+
+  OutputQueue() = default;
+  // releases zero-copy payloads not sent or not completed yet, the owner
+  // makes sure the kernel no longer reads the pages of the latter, e.g. by
+  // resetting the connection as TCPConnection does
+  ~OutputQueue();
+
+  bool Empty() const { return chunks_.empty(); }
+  // bytes and transfer lengths not written yet
+  std::size_t Size() const { return size_; }
+  void Append(std::string_view data);
+  // fd must stay open until the transfer is written
+  void AppendFile(int fd, off_t offset, std::size_t len);
+  // pipe_fd is expected to already hold len bytes
+  void AppendPipe(int pipe_fd, std::size_t len);
+  // data is sent with MSG_ZEROCOPY and stays owned by the caller, release runs
+  // once the kernel reports it no longer reads the pages; fd must have
+  // SO_ZEROCOPY set
+  void AppendZeroCopy(std::string_view data, std::function<void()> release);
+  // zero-copy payloads written but not reported complete yet, a payload at
+  // the front that went out in part counts too, the kernel reads its pages
+  std::size_t ZeroCopyInFlight() const {
+    bool is_front_sent = !chunks_.empty() && chunks_.front().IsZeroCopy() &&
+                         chunks_.front().zerocopy.has_seq;
+    return in_flight_.size() + (is_front_sent ? 1 : 0);
+  }
+  // read the completions on the error queue of fd and release the payloads
+  // they cover, return the number released; copied is set if the kernel
+  // fell back to copying, e.g. on loopback
+  std::size_t ReapZeroCopy(int fd, bool* copied = nullptr);
+  // write in order until the queue is empty or the socket is full, return
+  // the number of bytes written or -1 on error, syscalls counts the writes
+  // made if given
+  ssize_t WriteFD(int fd, std::size_t* syscalls = nullptr);
+
+ private:
+  struct Transfer {
+    int fd = -1;
+    off_t offset = 0;  // unused for pipes
+    std::size_t len = 0;
+    bool is_pipe = false;
+  };
+
+  struct ZeroCopy {
+    const char* data = nullptr;
+    std::size_t len = 0;
+    std::function<void()> release;
+    bool has_seq = false;  // some part went out with MSG_ZEROCOPY
+    uint32_t last_seq = 0;
+  };
+
+  struct Chunk {
+    Buffer buffer;
+    Transfer transfer;
+    ZeroCopy zerocopy;
+    bool IsTransfer() const { return transfer.fd != -1; }
+    bool IsZeroCopy() const { return zerocopy.len != 0; }
+    bool IsBytes() const { return !IsTransfer() && !IsZeroCopy(); }
+  };
+
+  // every MSG_ZEROCOPY send is numbered by the kernel, completions report
+  // ranges of these numbers
+  struct InFlight {
+    uint32_t seq = 0;
+    std::function<void()> release;
+  };
+
+  ssize_t WriteBuffers(int fd);
+  ssize_t WriteTransfer(int fd);
+  ssize_t WriteZeroCopy(int fd);
+
+ private:
+  std::deque<Chunk, PoolAllocator<Chunk>> chunks_;
+  std::size_t size_ = 0;
+  std::deque<InFlight> in_flight_;
+  uint32_t next_seq_ = 0;  // mirrors the counter of the socket
+  bool is_corked_ = false;  // the last write used MSG_MORE
+};
+
+}  // namespace jc
@@ -1,84 +1,202 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
+#include "base/concepts.h"
 #include "base/noncopyable.h"
+#include "net/fd_table.h"
+#include "net/metrics.h"
 #include "net/socket_utils.h"
+#include "net/task_queue.h"
+#include "net/timing_wheel.h"
 
 namespace jc {
 
 template <typename Derived>
 class PollerEpoll : noncopyable {
  public:
+  using TimerID = TimingWheel::TimerID;
+
+  PollerEpoll();
   ~PollerEpoll();
   void Loop();
+  // thread-safe, a loop blocked in another thread is woken up, a Loop()
+  // entered after Exit() returns at once
   void Exit();
-  void AddRead(int fd) const;
+  // edge-triggered fds are only reported on state changes, the handler must
+  // drain them until EAGAIN
+  void AddRead(int fd, bool edge_triggered = false);
+  // fd is already non-blocking, e.g. from accept4, skip the fcntl calls
+  void AddNonBlockingRead(int fd, bool edge_triggered = false);
+  // fd is non-blocking and watched by other loops too, e.g. a listen fd
+  // shared by prefork workers, only one of them is woken per event; it cannot
+  // be switched by SetRead or SetWrite later
+  void AddExclusiveRead(int fd, bool edge_triggered = false);
   void AddWrite(int fd) const;
   void SetRead(int fd) const;
   void SetWrite(int fd) const;
+  // watch both directions, OnRead and OnWrite may run for one event
+  void SetReadWrite(int fd) const;
   void Remove(int fd);
-  void AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f every millsec
+  TimerID AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f once after millsec
+  TimerID RunAfter(const std::function<void()>& f, uint64_t millsec);
+  bool CancelTimer(TimerID id);
+  bool ResetTimer(TimerID id, uint64_t millsec);
+  // run f in the loop thread, inline if already there
+  void RunInLoop(std::function<void()> f);
+  // thread-safe, f runs in the loop thread on its next iteration
+  void QueueInLoop(std::function<void()> f);
+  // drain mailbox, e.g. a Mailbox<T>, in the loop thread whenever messages
+  // arrive, f(T&) runs for each of them; mailbox must outlive the
+  // registration, RemoveMailbox() ends it
+  template <typename M, typename F>
+  void AddMailbox(M& mailbox, F f);
+  template <typename M>
+  void RemoveMailbox(M& mailbox);
+  bool IsInLoopThread() const;
+  // spin in epoll_wait with a zero timeout for up to budget_microsec before
+  // blocking, trading a core for wakeup latency; the budget halves after
+  // every spin that finds nothing, down to 1/16, and an event found while
+  // spinning restores it; sockets added afterwards also get SO_BUSY_POLL and
+  // SO_PREFER_BUSY_POLL; 0 blocks at once, call it before Loop()
+  void SetBusyPoll(uint64_t budget_microsec);
+  // lock-free to read from any thread, empty unless built with SNET_METRICS
+  const LoopMetrics& Metrics() const { return metrics_; }
+  bool IsEdgeTriggered(int fd) const;
+
+ private:
+  int Wait();
 
  private:
   int epfd_ = create_epfd();
-  bool is_running_ = false;
+  // cleared by Exit() and set again once the Loop() it ends returns
+  std::atomic<bool> is_running_ = true;
+  std::atomic<std::thread::id> thread_id_;
   std::vector<epoll_event> events_;
-  std::unordered_map<int, std::function<void()>> tfd_2_cb_;
+  TimingWheel timing_wheel_;
+  TaskQueue task_queue_;
+  FDTable<std::function<std::size_t()>> mailboxes_;
+  [[no_unique_address]] LoopMetrics metrics_;
+  FDTable<uint8_t> fds_edge_triggered_;
+  uint64_t busy_poll_nanosec_ = 0;
+  uint64_t spin_nanosec_ = 0;  // the current budget
+};
+
+template <typename Derived>
+inline PollerEpoll<Derived>::PollerEpoll() {
+  AddRead(timing_wheel_.FD());
+  AddRead(task_queue_.FD());
 };
 
 template <typename Derived>
 inline PollerEpoll<Derived>::~PollerEpoll() {
   is_running_ = false;
   ::close(epfd_);
-  std::ranges::for_each(tfd_2_cb_, [](const auto& x) { ::close(x.first); });
   printf("Desctuctor PollerEpoll\n");
 };
 
 template <typename Derived>
 inline void PollerEpoll<Derived>::Loop() {
+  // EPOLLERR is reported without being asked for, e.g. for zero-copy
+  // completions on the error queue, only a Derived with OnError(fd) takes it
+  constexpr bool has_on_error = has_on_error_v<Derived>;
+  thread_id_ = std::this_thread::get_id();
   events_.resize(16);
-  is_running_ = true;
   while (is_running_) {
-    int ret = ::epoll_wait(epfd_, events_.data(), events_.size(), 10000);
-    if (ret == 0 || errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+    int ret = Wait();
+    // errno is only meaningful on failure, handlers may leave a stale EAGAIN
+    if (ret == 0 || (ret < 0 && (errno == EINTR || errno == EAGAIN ||
+                                 errno == EWOULDBLOCK))) {
       continue;
     }
     if (ret < 0) {
       printf("failed to epoll_wait, errno[%d]=%s\n", errno, strerror(errno));
       exit(1);
     }
+    metrics_.OnWakeup(ret);
+    const uint64_t dispatch_start = metrics_.Now();
     std::ranges::for_each_n(events_.begin(), ret, [&](epoll_event& event) {
       int fd = event.data.fd;
-      if (tfd_2_cb_.contains(fd)) {
-        read_tfd(fd);
-        std::invoke(tfd_2_cb_.at(fd));
-      } else if (event.events & EPOLLIN) {
-        static_cast<Derived*>(this)->OnRead(fd);
-      } else if (event.events & EPOLLOUT) {
-        static_cast<Derived*>(this)->OnWrite(fd);
+      if (fd == timing_wheel_.FD()) {
+        metrics_.OnTimer(timing_wheel_.OnTimer(), timing_wheel_.Size());
+      } else if (fd == task_queue_.FD()) {
+        metrics_.OnTasks(task_queue_.OnWakeup());
+      } else if (auto* drain = mailboxes_.Find(fd); drain && *drain) {
+        metrics_.OnMailbox((*drain)());
+      } else if ((event.events & (EPOLLIN | EPOLLOUT)) ||
+                 (has_on_error && (event.events & EPOLLERR))) {
+        const uint64_t callback_start = metrics_.Now();
+        if constexpr (has_on_error) {
+          if (event.events & EPOLLERR) {
+            static_cast<Derived*>(this)->OnError(fd);
+          }
+        }
+        if (event.events & EPOLLIN) {
+          static_cast<Derived*>(this)->OnRead(fd);
+        }
+        if (event.events & EPOLLOUT) {
+          static_cast<Derived*>(this)->OnWrite(fd);
+        }
+        metrics_.OnCallback(callback_start);
       } else {
         printf("unsupport epoll event=%d\n", event.events);
         exit(1);
       }
     });
+    if constexpr (has_on_loop_end_v<Derived>) {
+      static_cast<Derived*>(this)->OnLoopEnd();
+    }
+    metrics_.OnDispatched(dispatch_start);
     if (static_cast<std::size_t>(ret) == events_.size()) {
       events_.resize(events_.size() * 2);
+      metrics_.OnEventArrayResized();
     }
   }
+  is_running_ = true;
 };
 
 template <typename Derived>
 inline void PollerEpoll<Derived>::Exit() {
   is_running_ = false;
+  if (!IsInLoopThread()) {
+    task_queue_.Wakeup();
+  }
+};
+
+template <typename Derived>
+inline void PollerEpoll<Derived>::AddRead(int fd, bool edge_triggered) {
+  socket_set_nonblocking(fd);
+  AddNonBlockingRead(fd, edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerEpoll<Derived>::AddNonBlockingRead(int fd,
+                                                     bool edge_triggered) {
+  fds_edge_triggered_[fd] = edge_triggered;
+  epfd_add_read(epfd_, fd, edge_triggered);
+  if (busy_poll_nanosec_ != 0) {
+    // best effort, fd may be no socket or the budget above net.core.busy_read
+    socket_set_busy_poll(fd, busy_poll_nanosec_ / 1000);
+    socket_set_prefer_busy_poll(fd);
+  }
 };
 
 template <typename Derived>
-inline void PollerEpoll<Derived>::AddRead(int fd) const {
-  epfd_add_read(epfd_, fd);
+inline void PollerEpoll<Derived>::AddExclusiveRead(int fd,
+                                                   bool edge_triggered) {
+  fds_edge_triggered_[fd] = edge_triggered;
+  if (!epfd_add_read_exclusive(epfd_, fd, edge_triggered)) {
+    printf("failed to add exclusive fd=%d, errno[%d]=%s\n", fd, errno,
+           strerror(errno));
+    exit(1);
+  }
 };
 
 template <typename Derived>
@@ -88,7 +206,7 @@ inline void PollerEpoll<Derived>::AddWrite(int fd) const {
 
 template <typename Derived>
 inline void PollerEpoll<Derived>::SetRead(int fd) const {
-  epfd_mod_read(epfd_, fd);
+  epfd_mod_read(epfd_, fd, IsEdgeTriggered(fd));
 };
 
 template <typename Derived>
@@ -96,22 +214,104 @@ inline void PollerEpoll<Derived>::SetWrite(int fd) const {
   epfd_mod_write(epfd_, fd);
 };
 
+template <typename Derived>
+inline void PollerEpoll<Derived>::SetReadWrite(int fd) const {
+  epfd_mod_read_write(epfd_, fd, IsEdgeTriggered(fd));
+};
+
 template <typename Derived>
 inline void PollerEpoll<Derived>::Remove(int fd) {
   epfd_del(epfd_, fd);
-  ::close(fd);
-  tfd_2_cb_.erase(fd);
+  fds_edge_triggered_.Reset(fd);
+};
+
+template <typename Derived>
+inline PollerEpoll<Derived>::TimerID PollerEpoll<Derived>::AddTimer(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec, millsec);
+};
+
+template <typename Derived>
+inline PollerEpoll<Derived>::TimerID PollerEpoll<Derived>::RunAfter(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec);
+};
+
+template <typename Derived>
+inline bool PollerEpoll<Derived>::CancelTimer(TimerID id) {
+  return timing_wheel_.Cancel(id);
+};
+
+template <typename Derived>
+inline bool PollerEpoll<Derived>::ResetTimer(TimerID id, uint64_t millsec) {
+  return timing_wheel_.Reset(id, millsec);
+};
+
+template <typename Derived>
+inline void PollerEpoll<Derived>::RunInLoop(std::function<void()> f) {
+  if (IsInLoopThread()) {
+    f();
+  } else {
+    QueueInLoop(std::move(f));
+  }
+};
+
+template <typename Derived>
+inline void PollerEpoll<Derived>::QueueInLoop(std::function<void()> f) {
+  task_queue_.Push(std::move(f));
+};
+
+template <typename Derived>
+template <typename M, typename F>
+inline void PollerEpoll<Derived>::AddMailbox(M& mailbox, F f) {
+  mailboxes_[mailbox.FD()] = [&mailbox, f = std::move(f)]() mutable {
+    return mailbox.Drain(f);
+  };
+  AddRead(mailbox.FD());
+};
+
+template <typename Derived>
+template <typename M>
+inline void PollerEpoll<Derived>::RemoveMailbox(M& mailbox) {
+  Remove(mailbox.FD());
+  mailboxes_.Reset(mailbox.FD());
+};
+
+template <typename Derived>
+inline bool PollerEpoll<Derived>::IsInLoopThread() const {
+  return thread_id_.load(std::memory_order_relaxed) ==
+         std::this_thread::get_id();
 };
 
 template <typename Derived>
-inline void PollerEpoll<Derived>::AddTimer(const std::function<void()>& f,
-                                           uint64_t millsec) {
-  if (!f) {
-    return;
+inline void PollerEpoll<Derived>::SetBusyPoll(uint64_t budget_microsec) {
+  busy_poll_nanosec_ = budget_microsec * 1000;
+  spin_nanosec_ = busy_poll_nanosec_;
+};
+
+template <typename Derived>
+inline bool PollerEpoll<Derived>::IsEdgeTriggered(int fd) const {
+  const uint8_t* edge_triggered = fds_edge_triggered_.Find(fd);
+  return edge_triggered && *edge_triggered;
+};
+
+template <typename Derived>
+inline int PollerEpoll<Derived>::Wait() {
+  if (spin_nanosec_ != 0) {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::nanoseconds(spin_nanosec_);
+    do {
+      int ret = ::epoll_wait(epfd_, events_.data(), events_.size(), 0);
+      if (ret != 0) {
+        spin_nanosec_ = busy_poll_nanosec_;
+        metrics_.OnBusyPollHit();
+        return ret;
+      }
+    } while (is_running_ && std::chrono::steady_clock::now() < deadline);
+    spin_nanosec_ = std::max(spin_nanosec_ / 2, busy_poll_nanosec_ / 16);
   }
-  int tfd = create_tfd(millsec);
-  tfd_2_cb_.try_emplace(tfd, f);
-  AddRead(tfd);
+  metrics_.OnBlockingWait();
+  return ::epoll_wait(epfd_, events_.data(), events_.size(), 10000);
 };
 
 }  // namespace jc
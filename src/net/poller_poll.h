@@ -2,141 +2,301 @@
 
 #include <sys/poll.h>
 
-#include <algorithm>
+#include <atomic>
 #include <functional>
-#include <unordered_map>
-#include <unordered_set>
+#include <thread>
 #include <vector>
 
+#include "base/concepts.h"
 #include "base/noncopyable.h"
+#include "net/fd_table.h"
+#include "net/metrics.h"
 #include "net/socket_utils.h"
+#include "net/task_queue.h"
+#include "net/timing_wheel.h"
 
 namespace jc {
 
+// fds map to their pollfd through an FDTable, so interest updates are O(1);
+// a removed entry is disabled in place by negating its fd, which poll()
+// skips, and swapped out with the last entry before the next poll()
 template <typename Derived>
 class PollerPoll : noncopyable {
  public:
+  using TimerID = TimingWheel::TimerID;
+
+  PollerPoll();
   ~PollerPoll();
   void Loop();
+  // thread-safe, a loop blocked in another thread is woken up, a Loop()
+  // entered after Exit() returns at once
   void Exit();
   void AddRead(int fd);
+  // fd is already non-blocking, e.g. from accept4, skip the fcntl calls
+  void AddNonBlockingRead(int fd);
   void AddWrite(int fd);
   void SetRead(int fd);
   void SetWrite(int fd);
+  // watch both directions, OnRead and OnWrite may run for one event
+  void SetReadWrite(int fd);
   void Remove(int fd);
-  void AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f every millsec
+  TimerID AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f once after millsec
+  TimerID RunAfter(const std::function<void()>& f, uint64_t millsec);
+  bool CancelTimer(TimerID id);
+  bool ResetTimer(TimerID id, uint64_t millsec);
+  // run f in the loop thread, inline if already there
+  void RunInLoop(std::function<void()> f);
+  // thread-safe, f runs in the loop thread on its next iteration
+  void QueueInLoop(std::function<void()> f);
+  // drain mailbox, e.g. a Mailbox<T>, in the loop thread whenever messages
+  // arrive, f(T&) runs for each of them; mailbox must outlive the
+  // registration, RemoveMailbox() ends it
+  template <typename M, typename F>
+  void AddMailbox(M& mailbox, F f);
+  template <typename M>
+  void RemoveMailbox(M& mailbox);
+  bool IsInLoopThread() const;
+  // lock-free to read from any thread, empty unless built with SNET_METRICS
+  const LoopMetrics& Metrics() const { return metrics_; }
 
  private:
+  // index of fd in events_, -1 if absent
+  struct Slot {
+    int index = -1;
+  };
+
+  void Add(int fd, short events);
+  void Set(int fd, short events);
+  // swap and pop the entries removed since the last call
   void ResetEvent();
 
  private:
-  bool is_running_ = false;
+  // cleared by Exit() and set again once the Loop() it ends returns
+  std::atomic<bool> is_running_ = true;
+  std::atomic<std::thread::id> thread_id_;
   std::vector<pollfd> events_;
-  std::unordered_set<int> fds_removed_;
-  std::unordered_map<int, std::function<void()>> tfd_2_cb_;
+  FDTable<Slot> slots_;
+  std::vector<int> fds_removed_;
+  TimingWheel timing_wheel_;
+  TaskQueue task_queue_;
+  FDTable<std::function<std::size_t()>> mailboxes_;
+  [[no_unique_address]] LoopMetrics metrics_;
+};
+
+template <typename Derived>
+inline PollerPoll<Derived>::PollerPoll() {
+  AddRead(timing_wheel_.FD());
+  AddRead(task_queue_.FD());
 };
 
 template <typename Derived>
 inline PollerPoll<Derived>::~PollerPoll() {
   is_running_ = false;
-  std::ranges::for_each(tfd_2_cb_, [](const auto& x) { ::close(x.first); });
   printf("Desctuctor PollerPoll\n");
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::Loop() {
-  is_running_ = true;
+  thread_id_ = std::this_thread::get_id();
   while (is_running_) {
     ResetEvent();
     int ret = ::poll(events_.data(), events_.size(), 10000);
-    if (ret == 0 || errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+    if (ret == 0 || (ret < 0 && (errno == EINTR || errno == EAGAIN ||
+                                 errno == EWOULDBLOCK))) {
       continue;
     }
     if (ret < 0) {
       printf("failed to poll, errno[%d]=%s\n", errno, strerror(errno));
       exit(1);
     }
+    // handlers may add fds and reallocate events_, so index instead of
+    // holding references, entries appended meanwhile were not polled
+    metrics_.OnWakeup(ret);
+    const uint64_t dispatch_start = metrics_.Now();
     std::size_t pfdn = events_.size();
-    std::ranges::for_each_n(events_.begin(), pfdn, [&](pollfd& pfd) {
-      int fd = pfd.fd;
-      if (pfd.revents & POLLIN) {
-        if (tfd_2_cb_.contains(fd)) {
-          read_tfd(fd);
-          std::invoke(tfd_2_cb_.at(fd));
+    for (std::size_t i = 0; i < pfdn && ret > 0; ++i) {
+      int fd = events_[i].fd;
+      short revents = events_[i].revents;
+      if (revents == 0) {
+        continue;
+      }
+      --ret;
+      // removed by an earlier handler of this iteration
+      if (fd < 0) {
+        continue;
+      }
+      const uint64_t callback_start = metrics_.Now();
+      if (revents & POLLIN) {
+        if (fd == timing_wheel_.FD()) {
+          metrics_.OnTimer(timing_wheel_.OnTimer(), timing_wheel_.Size());
+        } else if (fd == task_queue_.FD()) {
+          metrics_.OnTasks(task_queue_.OnWakeup());
+        } else if (auto* drain = mailboxes_.Find(fd); drain && *drain) {
+          metrics_.OnMailbox((*drain)());
         } else {
           static_cast<Derived*>(this)->OnRead(fd);
         }
-      } else if (pfd.revents & POLLOUT) {
+      }
+      // OnRead may have removed fd
+      if ((revents & POLLOUT) && slots_[fd].index != -1 &&
+          events_[slots_[fd].index].fd == fd) {
         static_cast<Derived*>(this)->OnWrite(fd);
       }
-    });
+      metrics_.OnCallback(callback_start);
+    }
+    if constexpr (has_on_loop_end_v<Derived>) {
+      static_cast<Derived*>(this)->OnLoopEnd();
+    }
+    metrics_.OnDispatched(dispatch_start);
   }
+  is_running_ = true;
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::Exit() {
   is_running_ = false;
+  if (!IsInLoopThread()) {
+    task_queue_.Wakeup();
+  }
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::AddRead(int fd) {
   socket_set_nonblocking(fd);
-  pollfd pfd;
-  pfd.fd = fd;
-  pfd.events = POLLIN;
-  events_.emplace_back(std::move(pfd));
+  AddNonBlockingRead(fd);
+};
+
+template <typename Derived>
+inline void PollerPoll<Derived>::AddNonBlockingRead(int fd) {
+  Add(fd, POLLIN);
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::AddWrite(int fd) {
   socket_set_nonblocking(fd);
-  pollfd pfd;
-  pfd.fd = fd;
-  pfd.events = POLLOUT;
-  events_.emplace_back(std::move(pfd));
+  Add(fd, POLLOUT);
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::SetRead(int fd) {
-  std::ranges::for_each(events_, [&](pollfd& pfd) {
-    if (pfd.fd == fd) {
-      pfd.events = POLLIN;
-    }
-  });
+  Set(fd, POLLIN);
 };
 
 template <typename Derived>
 inline void PollerPoll<Derived>::SetWrite(int fd) {
-  std::ranges::for_each(events_, [&](pollfd& pfd) {
-    if (pfd.fd == fd) {
-      pfd.events = POLLOUT;
-    }
-  });
+  Set(fd, POLLOUT);
 };
 
 template <typename Derived>
-inline void PollerPoll<Derived>::Remove(int fd) {
-  fds_removed_.emplace(fd);
-  ::close(fd);
-  tfd_2_cb_.erase(fd);
+inline void PollerPoll<Derived>::SetReadWrite(int fd) {
+  Set(fd, POLLIN | POLLOUT);
 };
 
 template <typename Derived>
-inline void PollerPoll<Derived>::AddTimer(const std::function<void()>& f,
-                                          uint64_t millsec) {
-  if (!f) {
+inline void PollerPoll<Derived>::Remove(int fd) {
+  Slot* slot = slots_.Find(fd);
+  if (!slot || slot->index == -1 || events_[slot->index].fd < 0) {
     return;
   }
-  int tfd = create_tfd(millsec);
-  tfd_2_cb_.try_emplace(tfd, f);
-  AddRead(tfd);
+  events_[slot->index].fd = ~fd;
+  fds_removed_.emplace_back(fd);
+};
+
+template <typename Derived>
+inline PollerPoll<Derived>::TimerID PollerPoll<Derived>::AddTimer(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec, millsec);
+};
+
+template <typename Derived>
+inline PollerPoll<Derived>::TimerID PollerPoll<Derived>::RunAfter(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec);
+};
+
+template <typename Derived>
+inline bool PollerPoll<Derived>::CancelTimer(TimerID id) {
+  return timing_wheel_.Cancel(id);
+};
+
+template <typename Derived>
+inline bool PollerPoll<Derived>::ResetTimer(TimerID id, uint64_t millsec) {
+  return timing_wheel_.Reset(id, millsec);
+};
+
+template <typename Derived>
+inline void PollerPoll<Derived>::RunInLoop(std::function<void()> f) {
+  if (IsInLoopThread()) {
+    f();
+  } else {
+    QueueInLoop(std::move(f));
+  }
+};
+
+template <typename Derived>
+inline void PollerPoll<Derived>::QueueInLoop(std::function<void()> f) {
+  task_queue_.Push(std::move(f));
+};
+
+template <typename Derived>
+template <typename M, typename F>
+inline void PollerPoll<Derived>::AddMailbox(M& mailbox, F f) {
+  mailboxes_[mailbox.FD()] = [&mailbox, f = std::move(f)]() mutable {
+    return mailbox.Drain(f);
+  };
+  AddRead(mailbox.FD());
+};
+
+template <typename Derived>
+template <typename M>
+inline void PollerPoll<Derived>::RemoveMailbox(M& mailbox) {
+  Remove(mailbox.FD());
+  mailboxes_.Reset(mailbox.FD());
 };
 
+template <typename Derived>
+inline bool PollerPoll<Derived>::IsInLoopThread() const {
+  return thread_id_.load(std::memory_order_relaxed) ==
+         std::this_thread::get_id();
+};
+
+template <typename Derived>
+inline void PollerPoll<Derived>::Add(int fd, short events) {
+  int& index = slots_[fd].index;
+  // re-added before the removal was applied, reuse the entry
+  if (index != -1) {
+    events_[index].fd = fd;
+    events_[index].events = events;
+    return;
+  }
+  index = events_.size();
+  events_.push_back({.fd = fd, .events = events, .revents = 0});
+}
+
+template <typename Derived>
+inline void PollerPoll<Derived>::Set(int fd, short events) {
+  Slot* slot = slots_.Find(fd);
+  if (slot && slot->index != -1) {
+    events_[slot->index].events = events;
+  }
+}
+
 template <typename Derived>
 inline void PollerPoll<Derived>::ResetEvent() {
-  std::erase_if(events_, [&](const pollfd& pfd) {
-    return fds_removed_.contains(pfd.fd);
-  });
+  for (int fd : fds_removed_) {
+    int index = slots_[fd].index;
+    // re-added since, or already swapped out by a duplicate removal
+    if (index == -1 || events_[index].fd != ~fd) {
+      continue;
+    }
+    pollfd& last = events_.back();
+    slots_[last.fd < 0 ? ~last.fd : last.fd].index = index;
+    events_[index] = last;
+    events_.pop_back();
+    slots_.Reset(fd);
+  }
   fds_removed_.clear();
 }
 
@@ -3,156 +3,294 @@
 #include <sys/select.h>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <thread>
-#include <unordered_map>
-#include <unordered_set>
 
+#include "base/concepts.h"
 #include "base/noncopyable.h"
+#include "net/fd_table.h"
+#include "net/metrics.h"
 #include "net/socket_utils.h"
+#include "net/task_queue.h"
+#include "net/timing_wheel.h"
 
 namespace jc {
 
+// the interest lives in master fd_sets updated in place and copied for each
+// select(), fds at or above max_fds_ cannot be watched, the Add calls return
+// false for them and the caller decides, e.g. closes the connection
 template <typename Derived>
 class PollerSelect : noncopyable {
  public:
+  using TimerID = TimingWheel::TimerID;
+
+  static constexpr int max_fds_ = FD_SETSIZE;
+
+  PollerSelect();
   ~PollerSelect();
   void Loop();
+  // thread-safe, a loop blocked in another thread is woken up, a Loop()
+  // entered after Exit() returns at once
   void Exit();
-  void AddRead(int fd);
-  void AddWrite(int fd);
+  bool AddRead(int fd);
+  // fd is already non-blocking, e.g. from accept4, skip the fcntl calls
+  bool AddNonBlockingRead(int fd);
+  bool AddWrite(int fd);
   void SetRead(int fd);
   void SetWrite(int fd);
+  // watch both directions, OnRead and OnWrite may run for one event
+  void SetReadWrite(int fd);
   void Remove(int fd);
-  void AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f every millsec
+  TimerID AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f once after millsec
+  TimerID RunAfter(const std::function<void()>& f, uint64_t millsec);
+  bool CancelTimer(TimerID id);
+  bool ResetTimer(TimerID id, uint64_t millsec);
+  // run f in the loop thread, inline if already there
+  void RunInLoop(std::function<void()> f);
+  // thread-safe, f runs in the loop thread on its next iteration
+  void QueueInLoop(std::function<void()> f);
+  // drain mailbox, e.g. a Mailbox<T>, in the loop thread whenever messages
+  // arrive, f(T&) runs for each of them; mailbox must outlive the
+  // registration, RemoveMailbox() ends it; false if its fd cannot be watched
+  template <typename M, typename F>
+  bool AddMailbox(M& mailbox, F f);
+  template <typename M>
+  void RemoveMailbox(M& mailbox);
+  bool IsInLoopThread() const;
+  // lock-free to read from any thread, empty unless built with SNET_METRICS
+  const LoopMetrics& Metrics() const { return metrics_; }
 
  private:
-  void ResetEvent();
+  bool Add(int fd, bool is_read, bool is_write);
+  void Set(int fd, bool is_read, bool is_write);
+  bool IsRegistered(int fd) const {
+    return fd >= 0 && fd <= max_fd_ &&
+           (FD_ISSET(fd, &read_set_) || FD_ISSET(fd, &write_set_));
+  }
 
  private:
-  struct Event {
-    int fd;
-    bool is_read;
-  };
-  bool is_running_ = false;
+  // cleared by Exit() and set again once the Loop() it ends returns
+  std::atomic<bool> is_running_ = true;
+  std::atomic<std::thread::id> thread_id_;
   int max_fd_ = -1;
-  fd_set event_read_;
-  fd_set event_write_;
-  std::vector<Event> events_;
-  std::unordered_set<int> fds_removed_;
-  std::unordered_map<int, std::function<void()>> tfd_2_cb_;
+  fd_set read_set_;
+  fd_set write_set_;
+  TimingWheel timing_wheel_;
+  TaskQueue task_queue_;
+  FDTable<std::function<std::size_t()>> mailboxes_;
+  [[no_unique_address]] LoopMetrics metrics_;
+};
+
+template <typename Derived>
+inline PollerSelect<Derived>::PollerSelect() {
+  FD_ZERO(&read_set_);
+  FD_ZERO(&write_set_);
+  if (!AddRead(timing_wheel_.FD()) || !AddRead(task_queue_.FD())) {
+    printf("no fd below FD_SETSIZE=%d is left for select\n", max_fds_);
+    exit(1);
+  }
 };
 
 template <typename Derived>
 inline PollerSelect<Derived>::~PollerSelect() {
   is_running_ = false;
-  std::ranges::for_each(tfd_2_cb_, [](const auto& x) { ::close(x.first); });
   printf("Desctuctor PollerSelect\n");
 };
 
 template <typename Derived>
 inline void PollerSelect<Derived>::Loop() {
-  timeval tv;
-  tv.tv_sec = 10;
-  tv.tv_usec = 0;
-  is_running_ = true;
+  thread_id_ = std::this_thread::get_id();
   while (is_running_) {
-    ResetEvent();
-    int ret = ::select(max_fd_ + 1, &event_read_, &event_write_, nullptr, &tv);
-    if (ret == 0 || errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+    fd_set ready_read = read_set_;
+    fd_set ready_write = write_set_;
+    // select() leaves the remaining time in tv on Linux
+    timeval tv = {.tv_sec = 10, .tv_usec = 0};
+    int ret = ::select(max_fd_ + 1, &ready_read, &ready_write, nullptr, &tv);
+    if (ret == 0 || (ret < 0 && (errno == EINTR || errno == EAGAIN ||
+                                 errno == EWOULDBLOCK))) {
       continue;
     }
     if (ret < 0) {
       printf("failed to select, errno[%d]=%s\n", errno, strerror(errno));
       exit(1);
     }
-    std::size_t nfds = events_.size();
-    std::ranges::for_each_n(events_.begin(), nfds, [&](Event& event) {
-      int fd = event.fd;
-      if (event.is_read && FD_ISSET(fd, &event_read_)) {
-        if (tfd_2_cb_.contains(fd)) {
-          read_tfd(fd);
-          std::invoke(tfd_2_cb_.at(fd));
+    // ret counts read and write readiness separately; the master sets are
+    // checked again because handlers may remove fds
+    metrics_.OnWakeup(ret);
+    const uint64_t dispatch_start = metrics_.Now();
+    for (int fd = 0; fd <= max_fd_ && ret > 0; ++fd) {
+      bool is_read = FD_ISSET(fd, &ready_read);
+      bool is_write = FD_ISSET(fd, &ready_write);
+      if (!is_read && !is_write) {
+        continue;
+      }
+      ret -= is_read + is_write;
+      const uint64_t callback_start = metrics_.Now();
+      if (is_read && FD_ISSET(fd, &read_set_)) {
+        if (fd == timing_wheel_.FD()) {
+          metrics_.OnTimer(timing_wheel_.OnTimer(), timing_wheel_.Size());
+        } else if (fd == task_queue_.FD()) {
+          metrics_.OnTasks(task_queue_.OnWakeup());
+        } else if (auto* drain = mailboxes_.Find(fd); drain && *drain) {
+          metrics_.OnMailbox((*drain)());
         } else {
           static_cast<Derived*>(this)->OnRead(fd);
         }
-      } else if (!event.is_read && FD_ISSET(fd, &event_write_)) {
+      }
+      if (is_write && FD_ISSET(fd, &write_set_)) {
         static_cast<Derived*>(this)->OnWrite(fd);
       }
-    });
+      metrics_.OnCallback(callback_start);
+    }
+    if constexpr (has_on_loop_end_v<Derived>) {
+      static_cast<Derived*>(this)->OnLoopEnd();
+    }
+    metrics_.OnDispatched(dispatch_start);
   }
+  is_running_ = true;
 };
 
 template <typename Derived>
 inline void PollerSelect<Derived>::Exit() {
   is_running_ = false;
+  if (!IsInLoopThread()) {
+    task_queue_.Wakeup();
+  }
 };
 
 template <typename Derived>
-inline void PollerSelect<Derived>::AddRead(int fd) {
+inline bool PollerSelect<Derived>::AddRead(int fd) {
   socket_set_nonblocking(fd);
-  FD_SET(fd, &event_read_);
-  events_.emplace_back(fd, true);
+  return AddNonBlockingRead(fd);
 };
 
 template <typename Derived>
-inline void PollerSelect<Derived>::AddWrite(int fd) {
+inline bool PollerSelect<Derived>::AddNonBlockingRead(int fd) {
+  return Add(fd, true, false);
+};
+
+template <typename Derived>
+inline bool PollerSelect<Derived>::AddWrite(int fd) {
   socket_set_nonblocking(fd);
-  FD_SET(fd, &event_write_);
-  events_.emplace_back(fd, false);
+  return Add(fd, false, true);
 };
 
 template <typename Derived>
 inline void PollerSelect<Derived>::SetRead(int fd) {
-  std::ranges::for_each(events_, [&](Event& event) {
-    if (event.fd == fd) {
-      event.is_read = true;
-    }
-  });
+  Set(fd, true, false);
 };
 
 template <typename Derived>
 inline void PollerSelect<Derived>::SetWrite(int fd) {
-  std::ranges::for_each(events_, [&](Event& event) {
-    if (event.fd == fd) {
-      event.is_read = false;
-    }
-  });
+  Set(fd, false, true);
+};
+
+template <typename Derived>
+inline void PollerSelect<Derived>::SetReadWrite(int fd) {
+  Set(fd, true, true);
 };
 
 template <typename Derived>
 inline void PollerSelect<Derived>::Remove(int fd) {
-  FD_CLR(fd, &event_read_);
-  FD_CLR(fd, &event_write_);
-  fds_removed_.emplace(fd);
-  ::close(fd);
-  tfd_2_cb_.erase(fd);
+  if (!IsRegistered(fd)) {
+    return;
+  }
+  FD_CLR(fd, &read_set_);
+  FD_CLR(fd, &write_set_);
+  while (max_fd_ >= 0 && !IsRegistered(max_fd_)) {
+    --max_fd_;
+  }
+};
+
+template <typename Derived>
+inline PollerSelect<Derived>::TimerID PollerSelect<Derived>::AddTimer(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec, millsec);
+};
+
+template <typename Derived>
+inline PollerSelect<Derived>::TimerID PollerSelect<Derived>::RunAfter(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec);
+};
+
+template <typename Derived>
+inline bool PollerSelect<Derived>::CancelTimer(TimerID id) {
+  return timing_wheel_.Cancel(id);
+};
+
+template <typename Derived>
+inline bool PollerSelect<Derived>::ResetTimer(TimerID id, uint64_t millsec) {
+  return timing_wheel_.Reset(id, millsec);
+};
+
+template <typename Derived>
+inline void PollerSelect<Derived>::RunInLoop(std::function<void()> f) {
+  if (IsInLoopThread()) {
+    f();
+  } else {
+    QueueInLoop(std::move(f));
+  }
+};
+
+template <typename Derived>
+inline void PollerSelect<Derived>::QueueInLoop(std::function<void()> f) {
+  task_queue_.Push(std::move(f));
 };
 
 template <typename Derived>
-inline void PollerSelect<Derived>::AddTimer(const std::function<void()>& f,
-                                            uint64_t millsec) {
-  if (!f) {
+template <typename M, typename F>
+inline bool PollerSelect<Derived>::AddMailbox(M& mailbox, F f) {
+  if (!AddRead(mailbox.FD())) {
+    return false;
+  }
+  mailboxes_[mailbox.FD()] = [&mailbox, f = std::move(f)]() mutable {
+    return mailbox.Drain(f);
+  };
+  return true;
+};
+
+template <typename Derived>
+template <typename M>
+inline void PollerSelect<Derived>::RemoveMailbox(M& mailbox) {
+  Remove(mailbox.FD());
+  mailboxes_.Reset(mailbox.FD());
+};
+
+template <typename Derived>
+inline bool PollerSelect<Derived>::IsInLoopThread() const {
+  return thread_id_.load(std::memory_order_relaxed) ==
+         std::this_thread::get_id();
+};
+
+template <typename Derived>
+inline bool PollerSelect<Derived>::Add(int fd, bool is_read, bool is_write) {
+  // FD_SET beyond FD_SETSIZE writes past the fd_set
+  if (fd < 0 || fd >= max_fds_) {
+    return false;
+  }
+  max_fd_ = std::max(max_fd_, fd);
+  // re-adding an fd only replaces its interest
+  FD_CLR(fd, &read_set_);
+  FD_CLR(fd, &write_set_);
+  if (is_read) {
+    FD_SET(fd, &read_set_);
+  }
+  if (is_write) {
+    FD_SET(fd, &write_set_);
+  }
+  return true;
+}
+
+template <typename Derived>
+inline void PollerSelect<Derived>::Set(int fd, bool is_read, bool is_write) {
+  if (!IsRegistered(fd)) {
     return;
   }
-  int tfd = create_tfd(millsec);
-  tfd_2_cb_.try_emplace(tfd, f);
-  AddRead(tfd);
-};
-
-template <typename Derived>
-inline void PollerSelect<Derived>::ResetEvent() {
-  FD_ZERO(&event_read_);
-  FD_ZERO(&event_write_);
-  std::erase_if(events_, [&](const Event& event) {
-    return fds_removed_.contains(event.fd);
-  });
-  fds_removed_.clear();
-  max_fd_ = -1;
-  std::ranges::for_each(events_, [&](const Event& event) {
-    max_fd_ = std::max(event.fd, max_fd_);
-    FD_SET(event.fd, event.is_read ? &event_read_ : &event_write_);
-  });
+  Add(fd, is_read, is_write);
 }
 
 }  // namespace jc
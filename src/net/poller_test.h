@@ -1,27 +1,94 @@
 #pragma once
 
+#include <algorithm>
 #include <concepts>
-#include <unordered_map>
+#include <optional>
+#include <thread>
+#include <vector>
 
 #include "base/concepts.h"
+#include "net/connector.h"
+#include "net/fd_table.h"
+#include "net/length_codec.h"
 #include "net/poller_epoll.h"
 #include "net/poller_poll.h"
 #include "net/poller_select.h"
+#include "net/poller_uring.h"
 #include "net/tcp_client.h"
 #include "net/tcp_server.h"
 
 namespace jc {
 
+struct PollerTCPServerOption {
+  // only takes effect on PollerEpoll and PollerUring
+  bool edge_triggered = false;
+  uint64_t idle_timeout_millsec = 0;  // 0 never closes idle connections
+  // a partial frame left in the input must grow within this, 0 waits forever
+  uint64_t read_timeout_millsec = 0;
+  // output left unsent must drain some bytes within this, 0 waits forever
+  uint64_t write_timeout_millsec = 0;
+  bool echo = false;  // echo input back silently instead of ping-pong
+  // echo or ping-pong per length-prefixed frame instead of per read
+  std::optional<LengthCodecOption> framing;
+  // only takes effect on PollerEpoll, the listen fd is shared with other
+  // processes and each connection wakes one of them, see PreforkServer
+  bool exclusive_accept = false;
+  // only takes effect on PollerEpoll, see PollerEpoll::SetBusyPoll
+  uint64_t busy_poll_microsec = 0;
+  // replies made during one loop iteration are written together per
+  // connection once every callback ran, instead of one send each
+  bool coalesce_writes = false;
+  // only takes effect on PollerUring, accept and recv with multishot
+  // requests instead of polling for readiness, edge_triggered is moot then
+  bool multishot = true;
+};
+
 template <template <typename> class Poller>
 requires(is_same_template_v<Poller, PollerEpoll> ||
          is_same_template_v<Poller, PollerPoll> ||
-         is_same_template_v<Poller, PollerSelect>) class PollerTCPServer
+         is_same_template_v<Poller, PollerSelect> ||
+         is_same_template_v<Poller, PollerUring>) class PollerTCPServer
     : public Poller<PollerTCPServer<Poller>> {
  public:
-  PollerTCPServer(std::string_view ip, uint16_t port,
-                  uint64_t timeout_millsec) {
-    server_ = std::make_unique<TCPServer>(ip, port);
-    this->AddRead(server_->FD());
+  PollerTCPServer(std::string_view ip, uint16_t port, uint64_t timeout_millsec,
+                  const PollerTCPServerOption& option = {})
+      : PollerTCPServer(std::make_unique<TCPServer>(ip, port), timeout_millsec,
+                        option) {}
+
+  PollerTCPServer(std::unique_ptr<TCPServer> server, uint64_t timeout_millsec,
+                  const PollerTCPServerOption& option = {})
+      : server_(std::move(server)),
+        edge_triggered_(option.edge_triggered &&
+                        (is_same_template_v<Poller, PollerEpoll> ||
+                         is_same_template_v<Poller, PollerUring>)),
+        idle_timeout_millsec_(option.idle_timeout_millsec),
+        read_timeout_millsec_(option.read_timeout_millsec),
+        write_timeout_millsec_(option.write_timeout_millsec),
+        echo_(option.echo),
+        coalesce_writes_(option.coalesce_writes),
+        multishot_(option.multishot &&
+                   is_same_template_v<Poller, PollerUring>) {
+    if (option.framing) {
+      codec_.emplace(*option.framing);
+    }
+    socket_set_nonblocking(server_->FD());
+    if constexpr (is_same_template_v<Poller, PollerEpoll>) {
+      this->SetBusyPoll(option.busy_poll_microsec);
+      if (option.exclusive_accept) {
+        this->AddExclusiveRead(server_->FD(), edge_triggered_);
+      } else {
+        AddReadFD(server_->FD());
+      }
+    } else if constexpr (is_same_template_v<Poller, PollerUring>) {
+      if (multishot_) {
+        this->AddMultishotAccept(server_->FD());
+      } else {
+        AddReadFD(server_->FD());
+      }
+    } else if (!AddReadFD(server_->FD())) {
+      printf("listen fd=%d cannot be watched\n", server_->FD());
+      exit(1);
+    }
     if (timeout_millsec != 0) {
       this->AddTimer([&] { this->Exit(); }, timeout_millsec);
     }
@@ -29,60 +96,320 @@ requires(is_same_template_v<Poller, PollerEpoll> ||
   }
 
   void OnRead(int fd) {
-    static int conn_cnt = 0;
     if (fd == server_->FD()) {
-      auto connection = server_->Accept();
-      ++conn_cnt;
-      int conn_fd = connection->FD();
-      this->AddRead(conn_fd);
-      fd_2_connections_[conn_fd] = std::move(connection);
-      fd_2_index_[conn_fd] = conn_cnt;
-      return;
-    }
-    if (fd_2_connections_.contains(fd)) {
-      auto& connection = fd_2_connections_.at(fd);
-      int len = connection->Recv(buf_, sizeof(buf_));
-      if (len == 0) {
-        this->Remove(fd);
-        fd_2_connections_.erase(fd);
-        fd_2_index_.erase(fd);
+      // an edge-triggered listen fd is not reported again for connections
+      // left in the backlog, so accept until a batch comes back short
+      std::size_t n = 0;
+      do {
+        n = server_->AcceptBatch(accepted_);
+        for (auto& connection : accepted_) {
+          OnAccepted(std::move(connection));
+        }
+        accepted_.clear();
+      } while (edge_triggered_ && n == TCPServer::max_batch_size_);
+      return;
+    }
+    Session* session = sessions_.Find(fd);
+    if (!session || !session->connection) {
+      return;
+    }
+    TCPConnection* connection = session->connection.get();
+    do {
+      int len = connection->RecvToBuffer();
+      if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (len <= 0) {
+        CloseConnection(fd);
         return;
       }
-      printf("connection[%d] server[%s] recv from client[%s], msg[%d]=%s\n",
-             fd_2_index_.at(fd), connection->PeerAddr().IPPort().c_str(),
-             connection->LocalAddr().IPPort().c_str(), len, buf_);
+    } while (edge_triggered_);
+    OnInput(fd, session);
+  }
+
+  // multishot accept on PollerUring, the kernel already accepted conn_fd
+  void OnAccept(int fd, int conn_fd) { OnAccepted(server_->Adopt(conn_fd)); }
+
+  // multishot recv on PollerUring, data is taken as if OnRead received it
+  void OnRecv(int fd, int res, std::string_view data) {
+    Session* session = sessions_.Find(fd);
+    if (!session || !session->connection) {
+      return;
+    }
+    if (res <= 0) {
+      CloseConnection(fd);
+      return;
+    }
+    session->connection->InputBuffer().Append(data);
+    OnInput(fd, session);
+  }
+
+  void OnWrite(int fd) {
+    Session* session = sessions_.Find(fd);
+    if (!session || !session->connection) {
+      return;
+    }
+    if (session->connection->FlushBuffer() == -1) {
+      CloseConnection(fd);
+      return;
+    }
+    SetDeadline(fd, session->write_timer,
+                session->connection->HasPendingOutput(),
+                write_timeout_millsec_, "write");
+  }
+
+  // flush the replies deferred during this iteration, each connection once
+  void OnLoopEnd() {
+    for (int fd : deferred_fds_) {
+      Session* session = sessions_.Find(fd);
+      // closed or replaced by a new connection meanwhile, flushing the new
+      // one is harmless
+      if (!session || !session->connection) {
+        continue;
+      }
+      if (session->connection->FlushBuffer() == -1) {
+        CloseConnection(fd);
+        continue;
+      }
+      SetDeadline(fd, session->write_timer,
+                  session->connection->HasPendingOutput(),
+                  write_timeout_millsec_, "write");
+    }
+    deferred_fds_.clear();
+  }
+
+  // zero-copy completions, a socket error is left to the next read
+  void OnError(int fd) {
+    Session* session = sessions_.Find(fd);
+    if (session && session->connection) {
+      session->connection->OnErrorQueue();
+    }
+  }
+
+ private:
+  struct Session {
+    std::unique_ptr<TCPConnection> connection;
+    int index = 0;
+    TimingWheel::TimerID idle_timer = 0;
+    TimingWheel::TimerID read_timer = 0;
+    TimingWheel::TimerID write_timer = 0;
+  };
+
+ private:
+  // process what arrived in the input buffer of session on fd
+  void OnInput(int fd, Session* session) {
+    TCPConnection* connection = session->connection.get();
+    Buffer& input = connection->InputBuffer();
+    if (input.ReadableBytes() == 0) {
+      return;
+    }
+    if (session->idle_timer != 0) {
+      this->ResetTimer(session->idle_timer, idle_timeout_millsec_);
+    }
+    if (codec_) {
+      if (!codec_->Decode(input,
+                          [&](auto frames) { OnFrames(*session, frames); })) {
+        printf("connection[%d] closed on an invalid frame\n", session->index);
+        CloseConnection(fd);
+      }
+    } else if (echo_) {
+      Reply(fd, *connection, input.View());
+      input.RetrieveAll();
+    } else {
+      printf("connection[%d] server[%s] recv from client[%s], msg[%zu]=%.*s\n",
+             session->index, connection->PeerAddr().IPPort().c_str(),
+             connection->LocalAddr().IPPort().c_str(), input.ReadableBytes(),
+             static_cast<int>(input.ReadableBytes()), input.Peek());
+      input.RetrieveAll();
       std::string msg = std::string{pong_msg_} + std::to_string(++index_);
-      connection->Send(const_cast<char*>(msg.c_str()), msg.size());
+      Reply(fd, *connection, msg);
+    }
+    // the session is gone if an invalid frame closed it
+    if (session->connection) {
+      SetDeadline(fd, session->read_timer, input.ReadableBytes() != 0,
+                  read_timeout_millsec_, "read");
+      SetDeadline(fd, session->write_timer,
+                  session->connection->HasPendingOutput(),
+                  write_timeout_millsec_, "write");
     }
   }
 
-  void OnWrite(int fd) { exit(1); }
+  void OnAccepted(std::unique_ptr<TCPConnection> connection) {
+    int conn_fd = connection->FD();
+    if (!AddReadFD(conn_fd)) {
+      // connection closes conn_fd on its way out
+      printf("connection fd=%d dropped, the poller cannot watch it\n",
+             conn_fd);
+      return;
+    }
+    ++conn_cnt_;
+    connection->SetWriteInterestCallback([this, conn_fd](bool enable) {
+      enable ? this->SetReadWrite(conn_fd) : this->SetRead(conn_fd);
+    });
+    Session& session = sessions_[conn_fd];
+    session.connection = std::move(connection);
+    session.index = conn_cnt_;
+    if (idle_timeout_millsec_ != 0) {
+      session.idle_timer = this->RunAfter(
+          [this, conn_fd] {
+            printf("connection[%d] closed after idle for %lu ms\n",
+                   sessions_[conn_fd].index, idle_timeout_millsec_);
+            CloseConnection(conn_fd);
+          },
+          idle_timeout_millsec_);
+    }
+  }
+
+  // one batch holds every frame completed by a read, replies are encoded
+  // into one output and sent together
+  void OnFrames(Session& session, std::span<const std::string_view> frames) {
+    output_.RetrieveAll();
+    for (std::string_view frame : frames) {
+      if (echo_) {
+        codec_->Encode(frame, output_);
+        continue;
+      }
+      printf("connection[%d] server[%s] recv from client[%s], "
+             "frame[%zu]=%.*s\n",
+             session.index, session.connection->PeerAddr().IPPort().c_str(),
+             session.connection->LocalAddr().IPPort().c_str(), frame.size(),
+             static_cast<int>(frame.size()), frame.data());
+      codec_->Encode(std::string{pong_msg_} + std::to_string(++index_),
+                     output_);
+    }
+    Reply(session.connection->FD(), *session.connection, output_.View());
+  }
+
+  void Reply(int fd, TCPConnection& connection, std::string_view data) {
+    if (!coalesce_writes_) {
+      connection.SendBuffered(data);
+    } else if (connection.SendDeferred(data)) {
+      deferred_fds_.push_back(fd);
+    }
+  }
+
+  // arm the deadline while pending, slide it on every call that finds it
+  // still pending and cancel it once nothing is pending
+  void SetDeadline(int fd, TimingWheel::TimerID& timer, bool pending,
+                   uint64_t millsec, const char* name) {
+    if (millsec == 0) {
+      return;
+    }
+    if (!pending) {
+      if (timer != 0) {
+        this->CancelTimer(timer);
+        timer = 0;
+      }
+      return;
+    }
+    if (timer != 0) {
+      this->ResetTimer(timer, millsec);
+      return;
+    }
+    timer = this->RunAfter(
+        [this, fd, millsec, name] {
+          printf("connection[%d] closed after no %s progress for %lu ms\n",
+                 sessions_[fd].index, name, millsec);
+          CloseConnection(fd);
+        },
+        millsec);
+  }
+
+  void CloseConnection(int fd) {
+    Session& session = sessions_[fd];
+    for (TimingWheel::TimerID timer :
+         {session.idle_timer, session.read_timer, session.write_timer}) {
+      if (timer != 0) {
+        this->CancelTimer(timer);
+      }
+    }
+    // the poller only deregisters the fd, TCPConnection closes it
+    this->Remove(fd);
+    sessions_.Reset(fd);
+  }
+
+  // every fd registered here is non-blocking already, false if the poller
+  // cannot watch fd, only PollerSelect has such a limit
+  bool AddReadFD(int fd) {
+    if constexpr (is_same_template_v<Poller, PollerUring>) {
+      multishot_ ? this->AddMultishotRecv(fd)
+                 : this->AddNonBlockingRead(fd, edge_triggered_);
+    } else if constexpr (is_same_template_v<Poller, PollerEpoll>) {
+      this->AddNonBlockingRead(fd, edge_triggered_);
+    } else if constexpr (is_same_template_v<Poller, PollerSelect>) {
+      return this->AddNonBlockingRead(fd);
+    } else {
+      this->AddNonBlockingRead(fd);
+    }
+    return true;
+  }
 
  private:
   static constexpr std::string_view pong_msg_ = "pong";
 
  private:
   std::unique_ptr<TCPServer> server_;
-  std::unordered_map<int, std::unique_ptr<TCPConnection>> fd_2_connections_;
-  std::unordered_map<int, int> fd_2_index_;
-  char buf_[1024] = {};
+  // reused across accept batches
+  std::vector<std::unique_ptr<TCPConnection>> accepted_;
+  FDTable<Session> sessions_;
+  bool edge_triggered_ = false;
+  uint64_t idle_timeout_millsec_ = 0;
+  uint64_t read_timeout_millsec_ = 0;
+  uint64_t write_timeout_millsec_ = 0;
+  bool echo_ = false;
+  bool coalesce_writes_ = false;
+  bool multishot_ = false;
+  std::vector<int> deferred_fds_;  // flushed by OnLoopEnd()
+  // frames are decoded straight from each input buffer, one codec serves
+  // every connection
+  std::optional<LengthCodec> codec_;
+  Buffer output_;  // replies of one frame batch
+  int conn_cnt_ = 0;
   int index_ = 0;
 };
 
+// one loop per thread, each loop owns a listen socket bound with SO_REUSEPORT
+// so the kernel shards incoming connections across the loops
+template <template <typename> class Poller>
+requires(is_same_template_v<Poller, PollerEpoll> ||
+         is_same_template_v<Poller, PollerPoll> ||
+         is_same_template_v<Poller, PollerSelect> ||
+         is_same_template_v<Poller, PollerUring>) class PollerTCPMultiServer
+    : noncopyable {
+ public:
+  PollerTCPMultiServer(std::string_view ip, uint16_t port,
+                       uint64_t timeout_millsec, std::size_t thread_num,
+                       const PollerTCPServerOption& option = {}) {
+    // bind all listen sockets before any loop starts so no connection is
+    // refused while the threads are spawning
+    std::vector<std::unique_ptr<TCPServer>> servers;
+    for (std::size_t i = 0; i < std::max<std::size_t>(thread_num, 1); ++i) {
+      servers.emplace_back(std::make_unique<TCPServer>(ip, port, true));
+    }
+    std::vector<std::jthread> threads;
+    for (auto& server : servers) {
+      threads.emplace_back([&, s = std::move(server)]() mutable {
+        PollerTCPServer<Poller>{std::move(s), timeout_millsec, option};
+      });
+    }
+  }
+};
+
 template <template <typename> class Poller>
 requires(is_same_template_v<Poller, PollerEpoll> ||
          is_same_template_v<Poller, PollerPoll> ||
-         is_same_template_v<Poller, PollerSelect>) class PollerTCPClient
+         is_same_template_v<Poller, PollerSelect> ||
+         is_same_template_v<Poller, PollerUring>) class PollerTCPClient
     : public Poller<PollerTCPClient<Poller>> {
  public:
   PollerTCPClient(std::string_view ip, uint16_t port,
-                  uint64_t timeout_millsec) {
-    client_ =
-        std::make_unique<TCPClient>(ip, port, "localhost", get_free_port());
-    do {
-      connection_ = client_->Connect();
-    } while (!connection_);
-    this->AddWrite(connection_->FD());
+                  uint64_t timeout_millsec,
+                  const ConnectorOption& option = {})
+      : connector_(*this, ip, port, option,
+                   [this](std::unique_ptr<TCPConnection> connection) {
+                     OnConnected(std::move(connection));
+                   }) {
+    connector_.Start();
     if (timeout_millsec != 0) {
       this->AddTimer([&] { this->Exit(); }, timeout_millsec);
     }
@@ -90,10 +417,10 @@ requires(is_same_template_v<Poller, PollerEpoll> ||
   }
 
   void OnRead(int fd) {
-    if (fd != connection_->FD()) {
+    if (!connection_ || fd != connection_->FD()) {
       return;
     }
-    int len = connection_->Recv(buf_, sizeof(buf_));
+    int len = connection_->RecvToBuffer();
     if (len == 0) {
       printf("OnDisconnected %s from %s\n",
              connection_->LocalAddr().IPPort().c_str(),
@@ -101,28 +428,65 @@ requires(is_same_template_v<Poller, PollerEpoll> ||
       this->Exit();
       return;
     }
-    printf("connection[1] client[%s] recv from server[%s], msg[%d]=%s\n",
+    if (len < 0) {
+      return;
+    }
+    Buffer& input = connection_->InputBuffer();
+    printf("connection[1] client[%s] recv from server[%s], msg[%zu]=%.*s\n",
            connection_->LocalAddr().IPPort().c_str(),
-           connection_->PeerAddr().IPPort().c_str(), len, buf_);
-    this->SetWrite(fd);
+           connection_->PeerAddr().IPPort().c_str(), input.ReadableBytes(),
+           static_cast<int>(input.ReadableBytes()), input.Peek());
+    input.RetrieveAll();
+    SendPing();
   }
 
   void OnWrite(int fd) {
-    if (fd != connection_->FD()) {
+    if (fd == connector_.FD()) {
+      connector_.OnWrite();
+      return;
+    }
+    if (!connection_ || fd != connection_->FD()) {
+      return;
+    }
+    connection_->FlushBuffer();
+  }
+
+ private:
+  void OnConnected(std::unique_ptr<TCPConnection> connection) {
+    if (!connection) {
+      printf("failed to connect after %d attempts\n", connector_.Attempts());
+      this->Exit();
       return;
     }
+    connection_ = std::move(connection);
+    int fd = connection_->FD();
+    if constexpr (is_same_template_v<Poller, PollerSelect>) {
+      if (!this->AddRead(fd)) {
+        printf("connection fd=%d dropped, select cannot watch it\n", fd);
+        connection_.reset();
+        this->Exit();
+        return;
+      }
+    } else {
+      this->AddRead(fd);
+    }
+    connection_->SetWriteInterestCallback([this, fd](bool enable) {
+      enable ? this->SetReadWrite(fd) : this->SetRead(fd);
+    });
+    SendPing();
+  }
+
+  void SendPing() {
     std::string msg = std::string{ping_msg_} + std::to_string(++index_);
-    connection_->Send(const_cast<char*>(msg.c_str()), msg.size());
-    this->SetRead(fd);
+    connection_->SendBuffered(msg);
   }
 
  private:
   static constexpr std::string_view ping_msg_ = "ping";
 
  private:
-  std::unique_ptr<TCPClient> client_;
+  Connector<PollerTCPClient> connector_;
   std::unique_ptr<TCPConnection> connection_;
-  char buf_[1024] = {};
   int index_ = 0;
 };
 
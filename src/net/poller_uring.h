@@ -0,0 +1,528 @@
+#pragma once
+
+#include <sys/poll.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "base/concepts.h"
+#include "base/noncopyable.h"
+#include "net/fd_table.h"
+#include "net/io_uring.h"
+#include "net/metrics.h"
+#include "net/socket_utils.h"
+#include "net/task_queue.h"
+#include "net/timing_wheel.h"
+
+namespace jc {
+
+// readiness is polled through io_uring, every interest change made while
+// dispatching is queued as an SQE and submitted together with the wait for
+// the next completions, so one io_uring_enter serves a whole batch; fds added
+// with AddMultishotAccept or AddMultishotRecv skip readiness altogether, the
+// kernel accepts or receives on its own and only hands over the results
+template <typename Derived>
+class PollerUring : noncopyable {
+ public:
+  using TimerID = TimingWheel::TimerID;
+
+  PollerUring();
+  ~PollerUring();
+  void Loop();
+  // thread-safe, a loop blocked in another thread is woken up, a Loop()
+  // entered after Exit() returns at once
+  void Exit();
+  // edge-triggered fds use one multishot poll, level-triggered fds are
+  // re-armed with a oneshot poll after every dispatch
+  void AddRead(int fd, bool edge_triggered = false);
+  // fd is already non-blocking, e.g. from accept4, skip the fcntl calls
+  void AddNonBlockingRead(int fd, bool edge_triggered = false);
+  // accept on listen fd with one multishot request, every connection is
+  // passed to Derived::OnAccept(fd, conn_fd) as a non-blocking fd; kernels
+  // without multishot accept (5.19) fall back to AddNonBlockingRead(fd)
+  void AddMultishotAccept(int fd);
+  // receive on fd with one multishot request into the provided buffer ring,
+  // Derived::OnRecv(fd, res, data) runs per completion where res is the
+  // byte count, 0 on EOF or -errno, data is only valid during the call and
+  // no more data follows after res <= 0; SetRead, SetWrite and SetReadWrite
+  // only change write interest; kernels without multishot recv (6.0) fall
+  // back to AddNonBlockingRead(fd)
+  void AddMultishotRecv(int fd);
+  void AddWrite(int fd);
+  void SetRead(int fd);
+  void SetWrite(int fd);
+  // watch both directions, OnRead and OnWrite may run for one completion
+  void SetReadWrite(int fd);
+  void Remove(int fd);
+  // run f every millsec
+  TimerID AddTimer(const std::function<void()>& f, uint64_t millsec);
+  // run f once after millsec
+  TimerID RunAfter(const std::function<void()>& f, uint64_t millsec);
+  bool CancelTimer(TimerID id);
+  bool ResetTimer(TimerID id, uint64_t millsec);
+  // run f in the loop thread, inline if already there
+  void RunInLoop(std::function<void()> f);
+  // thread-safe, f runs in the loop thread on its next iteration
+  void QueueInLoop(std::function<void()> f);
+  // drain mailbox, e.g. a Mailbox<T>, in the loop thread whenever messages
+  // arrive, f(T&) runs for each of them; mailbox must outlive the
+  // registration, RemoveMailbox() ends it
+  template <typename M, typename F>
+  void AddMailbox(M& mailbox, F f);
+  template <typename M>
+  void RemoveMailbox(M& mailbox);
+  bool IsInLoopThread() const;
+  // lock-free to read from any thread, empty unless built with SNET_METRICS
+  const LoopMetrics& Metrics() const { return metrics_; }
+  bool IsEdgeTriggered(int fd) const;
+
+ private:
+  struct Event {
+    uint32_t events = 0;  // polled, POLLIN is left to a multishot request
+    uint32_t generation = 0;
+    uint32_t multishot_generation = 0;
+    uint64_t multishot = poll_op_;  // accept_op_ or recv_op_ if any
+    bool edge_triggered = false;
+    bool is_armed = false;            // a poll request is in flight
+    bool is_multishot_armed = false;  // a multishot request is in flight
+  };
+
+  // user_data is generation << 34 | op << 32 | fd, completions of an older
+  // registration of the same fd are dropped
+  static constexpr uint64_t poll_op_ = 0;
+  static constexpr uint64_t accept_op_ = 1;
+  static constexpr uint64_t recv_op_ = 2;
+  static constexpr uint32_t generation_mask_ = (1u << 30) - 1;
+  static constexpr uint64_t ignore_data_ = UINT64_MAX;
+  // provided buffers shared by every multishot recv of the loop
+  static constexpr unsigned recv_buffer_num_ = 256;
+  static constexpr std::size_t recv_buffer_size_ = 4096;
+  // pause before a multishot accept that failed on exhaustion is re-armed
+  static constexpr uint64_t accept_retry_millsec_ = 100;
+
+ private:
+  void Register(int fd, uint32_t events, bool edge_triggered);
+  static uint64_t UserData(int fd, uint64_t op, uint32_t generation) {
+    return (static_cast<uint64_t>(generation & generation_mask_) << 34) |
+           (op << 32) | static_cast<uint32_t>(fd);
+  }
+  void Arm(int fd);
+  void Disarm(int fd);
+  void ArmMultishot(int fd);
+  void DisarmMultishot(int fd);
+  void OnCompletion(const io_uring_cqe& cqe);
+  void OnMultishotCompletion(const io_uring_cqe& cqe);
+
+ private:
+  IOUring ring_;
+  // cleared by Exit() and set again once the Loop() it ends returns
+  std::atomic<bool> is_running_ = true;
+  std::atomic<std::thread::id> thread_id_;
+  FDTable<Event> events_;
+  TimingWheel timing_wheel_;
+  TaskQueue task_queue_;
+  FDTable<std::function<std::size_t()>> mailboxes_;
+  [[no_unique_address]] LoopMetrics metrics_;
+  bool is_buffer_ring_failed_ = false;
+};
+
+template <typename Derived>
+inline PollerUring<Derived>::PollerUring() {
+  AddRead(timing_wheel_.FD());
+  AddRead(task_queue_.FD());
+};
+
+template <typename Derived>
+inline PollerUring<Derived>::~PollerUring() {
+  is_running_ = false;
+  printf("Desctuctor PollerUring\n");
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Loop() {
+  thread_id_ = std::this_thread::get_id();
+  while (is_running_) {
+    ring_.SubmitAndWait(1, 10000);
+    int completions = 0;
+    const uint64_t dispatch_start = metrics_.Now();
+    ring_.ForEachCQE([&](const io_uring_cqe& cqe) {
+      ++completions;
+      OnCompletion(cqe);
+    });
+    if (completions != 0) {
+      metrics_.OnWakeup(completions);
+      if constexpr (has_on_loop_end_v<Derived>) {
+        static_cast<Derived*>(this)->OnLoopEnd();
+      }
+      metrics_.OnDispatched(dispatch_start);
+    }
+  }
+  is_running_ = true;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Exit() {
+  is_running_ = false;
+  if (!IsInLoopThread()) {
+    task_queue_.Wakeup();
+  }
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::AddRead(int fd, bool edge_triggered) {
+  socket_set_nonblocking(fd);
+  AddNonBlockingRead(fd, edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::AddNonBlockingRead(int fd,
+                                                     bool edge_triggered) {
+  Register(fd, POLLIN, edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::AddMultishotAccept(int fd) {
+  static_assert(has_on_accept_v<Derived>,
+                "Derived lacks OnAccept(fd, conn_fd)");
+  events_[fd].multishot = accept_op_;
+  Register(fd, 0, false);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::AddMultishotRecv(int fd) {
+  static_assert(has_on_recv_v<Derived>,
+                "Derived lacks OnRecv(fd, res, data)");
+  if (!ring_.HasBufferRing() && !is_buffer_ring_failed_ &&
+      !ring_.SetupBufferRing(recv_buffer_num_, recv_buffer_size_)) {
+    printf("provided buffer ring is not supported, recv on readiness\n");
+    is_buffer_ring_failed_ = true;
+  }
+  if (!ring_.HasBufferRing()) {
+    AddNonBlockingRead(fd);
+    return;
+  }
+  events_[fd].multishot = recv_op_;
+  Register(fd, 0, false);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::AddWrite(int fd) {
+  socket_set_nonblocking(fd);
+  Register(fd, POLLOUT, false);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::SetRead(int fd) {
+  Register(fd, POLLIN, events_[fd].edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::SetWrite(int fd) {
+  Register(fd, POLLOUT, events_[fd].edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::SetReadWrite(int fd) {
+  Register(fd, POLLIN | POLLOUT, events_[fd].edge_triggered);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Remove(int fd) {
+  Disarm(fd);
+  DisarmMultishot(fd);
+  Event& event = events_[fd];
+  event.events = 0;
+  event.multishot = poll_op_;
+  event.edge_triggered = false;
+};
+
+template <typename Derived>
+inline PollerUring<Derived>::TimerID PollerUring<Derived>::AddTimer(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec, millsec);
+};
+
+template <typename Derived>
+inline PollerUring<Derived>::TimerID PollerUring<Derived>::RunAfter(
+    const std::function<void()>& f, uint64_t millsec) {
+  return timing_wheel_.Add(f, millsec);
+};
+
+template <typename Derived>
+inline bool PollerUring<Derived>::CancelTimer(TimerID id) {
+  return timing_wheel_.Cancel(id);
+};
+
+template <typename Derived>
+inline bool PollerUring<Derived>::ResetTimer(TimerID id, uint64_t millsec) {
+  return timing_wheel_.Reset(id, millsec);
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::RunInLoop(std::function<void()> f) {
+  if (IsInLoopThread()) {
+    f();
+  } else {
+    QueueInLoop(std::move(f));
+  }
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::QueueInLoop(std::function<void()> f) {
+  task_queue_.Push(std::move(f));
+};
+
+template <typename Derived>
+template <typename M, typename F>
+inline void PollerUring<Derived>::AddMailbox(M& mailbox, F f) {
+  mailboxes_[mailbox.FD()] = [&mailbox, f = std::move(f)]() mutable {
+    return mailbox.Drain(f);
+  };
+  AddRead(mailbox.FD());
+};
+
+template <typename Derived>
+template <typename M>
+inline void PollerUring<Derived>::RemoveMailbox(M& mailbox) {
+  Remove(mailbox.FD());
+  mailboxes_.Reset(mailbox.FD());
+};
+
+template <typename Derived>
+inline bool PollerUring<Derived>::IsInLoopThread() const {
+  return thread_id_.load(std::memory_order_relaxed) ==
+         std::this_thread::get_id();
+};
+
+template <typename Derived>
+inline bool PollerUring<Derived>::IsEdgeTriggered(int fd) const {
+  const Event* event = events_.Find(fd);
+  return event && event->edge_triggered;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Register(int fd, uint32_t events,
+                                           bool edge_triggered) {
+  Disarm(fd);
+  Event& event = events_[fd];
+  event.events = event.multishot != poll_op_ ? events & ~POLLIN : events;
+  event.edge_triggered = edge_triggered;
+  if (event.events != 0) {
+    Arm(fd);
+  }
+  if (event.multishot != poll_op_ && !event.is_multishot_armed) {
+    ArmMultishot(fd);
+  }
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Arm(int fd) {
+  Event& event = events_[fd];
+  io_uring_sqe* sqe = ring_.GetSQE();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = event.events;
+  if (event.edge_triggered) {
+    sqe->len = IORING_POLL_ADD_MULTI;
+  }
+  sqe->user_data = UserData(fd, poll_op_, event.generation);
+  event.is_armed = true;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::Disarm(int fd) {
+  Event& event = events_[fd];
+  if (event.is_armed) {
+    io_uring_sqe* sqe = ring_.GetSQE();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = UserData(fd, poll_op_, event.generation);
+    sqe->user_data = ignore_data_;
+    event.is_armed = false;
+  }
+  ++event.generation;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::ArmMultishot(int fd) {
+  Event& event = events_[fd];
+  io_uring_sqe* sqe = ring_.GetSQE();
+  sqe->fd = fd;
+  if (event.multishot == accept_op_) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  } else {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = IOUring::buffer_group_;
+  }
+  sqe->user_data = UserData(fd, event.multishot, event.multishot_generation);
+  event.is_multishot_armed = true;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::DisarmMultishot(int fd) {
+  Event& event = events_[fd];
+  if (event.is_multishot_armed) {
+    io_uring_sqe* sqe = ring_.GetSQE();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = UserData(fd, event.multishot, event.multishot_generation);
+    sqe->user_data = ignore_data_;
+    event.is_multishot_armed = false;
+  }
+  ++event.multishot_generation;
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::OnCompletion(const io_uring_cqe& cqe) {
+  if (cqe.user_data == ignore_data_) {
+    return;
+  }
+  if (((cqe.user_data >> 32) & 3) != poll_op_) {
+    OnMultishotCompletion(cqe);
+    return;
+  }
+  int fd = static_cast<int>(cqe.user_data & UINT32_MAX);
+  Event& event = events_[fd];
+  if (event.events == 0 ||
+      (event.generation & generation_mask_) != (cqe.user_data >> 34)) {
+    return;
+  }
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    event.is_armed = false;
+  }
+  if (cqe.res < 0) {
+    if (cqe.res != -ECANCELED) {
+      printf("failed to poll fd=%d, errno[%d]=%s\n", fd, -cqe.res,
+             strerror(-cqe.res));
+    }
+    return;
+  }
+  if (fd == timing_wheel_.FD()) {
+    metrics_.OnTimer(timing_wheel_.OnTimer(), timing_wheel_.Size());
+  } else if (fd == task_queue_.FD()) {
+    metrics_.OnTasks(task_queue_.OnWakeup());
+  } else if (auto* drain = mailboxes_.Find(fd); drain && *drain) {
+    metrics_.OnMailbox((*drain)());
+  } else if (event.events != (POLLIN | POLLOUT)) {
+    const uint64_t callback_start = metrics_.Now();
+    if (event.events & POLLIN) {
+      static_cast<Derived*>(this)->OnRead(fd);
+    } else {
+      static_cast<Derived*>(this)->OnWrite(fd);
+    }
+    metrics_.OnCallback(callback_start);
+  } else {
+    const uint64_t callback_start = metrics_.Now();
+    // res holds the ready events, errors go to both handlers
+    if (cqe.res & ~POLLOUT) {
+      static_cast<Derived*>(this)->OnRead(fd);
+    }
+    if (cqe.res & (POLLOUT | POLLERR | POLLHUP)) {
+      static_cast<Derived*>(this)->OnWrite(fd);
+    }
+    metrics_.OnCallback(callback_start);
+  }
+  // the handler may have removed or re-registered the fd, a oneshot poll
+  // that is still wanted is re-armed and will report again if the fd stays
+  // ready, which keeps level-triggered semantics
+  Event& current = events_[fd];
+  if (current.events != 0 && !current.is_armed &&
+      (current.generation & generation_mask_) == (cqe.user_data >> 34)) {
+    Arm(fd);
+  }
+};
+
+template <typename Derived>
+inline void PollerUring<Derived>::OnMultishotCompletion(
+    const io_uring_cqe& cqe) {
+  int fd = static_cast<int>(cqe.user_data & UINT32_MAX);
+  const uint64_t op = (cqe.user_data >> 32) & 3;
+  const uint32_t generation = cqe.user_data >> 34;
+  // a buffer is picked even for completions that are dropped below, it must
+  // go back to the ring after the data is consumed either way
+  const bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+  const unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  Event& event = events_[fd];
+  if (event.multishot != op ||
+      (event.multishot_generation & generation_mask_) != generation) {
+    if (op == accept_op_ && cqe.res >= 0) {
+      ::close(cqe.res);  // accepted before the cancel took effect
+    }
+    if (has_buffer) {
+      ring_.RecycleBuffer(bid);
+    }
+    return;
+  }
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    event.is_multishot_armed = false;
+  }
+  if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+    printf("multishot %s is not supported on fd=%d, polling instead\n",
+           op == accept_op_ ? "accept" : "recv", fd);
+    const uint32_t events = event.events | POLLIN;
+    Remove(fd);
+    Register(fd, events, false);
+    return;
+  }
+  // ENOBUFS only pauses a multishot recv until buffers are recycled, it is
+  // re-armed below
+  if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+    const uint64_t callback_start = metrics_.Now();
+    if constexpr (has_on_accept_v<Derived>) {
+      if (op == accept_op_) {
+        if (cqe.res >= 0) {
+          static_cast<Derived*>(this)->OnAccept(fd, cqe.res);
+        } else {
+          printf("failed to accept fd=%d, errno[%d]=%s\n", fd, -cqe.res,
+                 strerror(-cqe.res));
+        }
+      }
+    }
+    if constexpr (has_on_recv_v<Derived>) {
+      if (op == recv_op_) {
+        std::string_view data;
+        if (has_buffer && cqe.res > 0) {
+          data = ring_.BufferData(bid, cqe.res);
+        }
+        static_cast<Derived*>(this)->OnRecv(fd, cqe.res, data);
+      }
+    }
+    metrics_.OnCallback(callback_start);
+  }
+  if (has_buffer) {
+    ring_.RecycleBuffer(bid);
+  }
+  // a recv that ended on EOF or an error stays down, the handler is
+  // expected to remove the fd
+  Event& current = events_[fd];
+  if (current.multishot != op || current.is_multishot_armed ||
+      (current.multishot_generation & generation_mask_) != generation) {
+    return;
+  }
+  if (op == recv_op_ && cqe.res <= 0 && cqe.res != -ENOBUFS) {
+    return;
+  }
+  // an accept that failed on EMFILE, ENOMEM and the like would fail again at
+  // once, it is re-armed after a pause so the loop does not spin
+  if (op == accept_op_ && cqe.res < 0 && cqe.res != -ECONNABORTED &&
+      cqe.res != -EINTR && cqe.res != -EAGAIN && cqe.res != -ECANCELED) {
+    RunAfter(
+        [this, fd, generation] {
+          Event& e = events_[fd];
+          if (e.multishot == accept_op_ && !e.is_multishot_armed &&
+              (e.multishot_generation & generation_mask_) == generation) {
+            ArmMultishot(fd);
+          }
+        },
+        accept_retry_millsec_);
+    return;
+  }
+  ArmMultishot(fd);
+};
+
+}  // namespace jc
@@ -0,0 +1,160 @@
+#include "net/prefork_server.h"
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "net/socket_utils.h"
+
+namespace jc {
+
+namespace {
+
+std::vector<int> allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (::sched_getaffinity(0, sizeof(set), &set) == -1) {
+    printf("failed to sched_getaffinity, errno[%d]=%s\n", errno,
+           strerror(errno));
+    exit(1);
+  }
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+bool pin_to_cpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return ::sched_setaffinity(0, sizeof(set), &set) != -1;
+}
+
+}  // namespace
+
+PreforkServer::PreforkServer(std::string_view ip, uint16_t port,
+                             std::size_t worker_num, WorkerFunc f,
+                             bool pin_cpu)
+    : server_(std::make_unique<TCPServer>(ip, port)),
+      f_(std::move(f)),
+      pin_cpu_(pin_cpu),
+      cpus_(allowed_cpus()),
+      workers_(worker_num != 0 ? worker_num : cpus_.size(), -1) {
+  // the workers share the open file description, one woken for a connection
+  // another worker took gets EAGAIN instead of blocking in accept
+  socket_set_nonblocking(server_->FD());
+}
+
+PreforkServer::~PreforkServer() {
+  Stop();
+  while (live_ > 0) {
+    int status = 0;
+    pid_t pid = ::waitpid(-1, &status, 0);
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    Reap(pid, status);
+  }
+}
+
+void PreforkServer::Run() {
+  // the process calling Run() is the master, not necessarily the one that
+  // constructed this
+  master_pid_ = ::getpid();
+  is_running_ = true;
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    Spawn(i);
+  }
+  while (live_ > 0) {
+    int status = 0;
+    pid_t pid = ::waitpid(-1, &status, 0);
+    if (pid == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // e.g. ECHILD if SIGCHLD is ignored and the kernel reaps the workers
+      printf("failed to waitpid, errno[%d]=%s\n", errno, strerror(errno));
+      exit(1);
+    }
+    Reap(pid, status);
+  }
+  is_running_ = false;
+}
+
+void PreforkServer::Stop() {
+  is_running_ = false;
+  for (pid_t pid : workers_) {
+    if (pid > 0) {
+      ::kill(pid, SIGTERM);
+    }
+  }
+}
+
+void PreforkServer::Spawn(std::size_t index) {
+  // the worker would print whatever is left in the inherited stdio buffer
+  // once more
+  fflush(stdout);
+  pid_t pid = ::fork();
+  if (pid == -1) {
+    printf("failed to fork=%s\n", strerror(errno));
+    exit(1);
+  }
+  if (pid == 0) {
+    // an orphaned worker would keep serving the port without supervision
+    ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+    // the worker ends with _exit, exit handlers and static destructors
+    // belong to the master
+    if (::getppid() != master_pid_) {
+      ::_exit(1);
+    }
+    if (pin_cpu_ && !pin_to_cpu(cpus_[index % cpus_.size()])) {
+      printf("failed to pin worker[%zu] to cpu=%d\n", index,
+             cpus_[index % cpus_.size()]);
+      fflush(stdout);
+      ::_exit(1);
+    }
+    f_(std::move(server_), index);
+    fflush(stdout);
+    ::_exit(0);
+  }
+  workers_[index] = pid;
+  ++live_;
+}
+
+void PreforkServer::Reap(pid_t pid, int status) {
+  auto it = std::ranges::find(workers_, pid);
+  if (it == workers_.end()) {
+    return;  // a child forked by someone else
+  }
+  *it = -1;
+  --live_;
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    return;
+  }
+  std::size_t index = it - workers_.begin();
+  if (WIFSIGNALED(status)) {
+    printf("worker[%zu] pid=%d killed by signal %d\n", index, pid,
+           WTERMSIG(status));
+  } else {
+    printf("worker[%zu] pid=%d exited with %d\n", index, pid,
+           WEXITSTATUS(status));
+  }
+  if (is_running_) {
+    ++respawns_;
+    Spawn(index);
+  }
+}
+
+}  // namespace jc
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "base/noncopyable.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// the master binds one non-blocking listen socket and forks long-lived
+// workers that all accept from it, e.g. each running its own PollerEpoll
+// loop registered with AddExclusiveRead so one connection wakes one worker;
+// a worker killed by a signal or exiting non-zero is respawned in its slot
+class PreforkServer : noncopyable {
+ public:
+  // runs in the forked worker, the worker exits with 0 once it returns
+  using WorkerFunc =
+      std::function<void(std::unique_ptr<TCPServer> server, std::size_t index)>;
+
+  // worker_num 0 forks one worker per CPU the master may run on, worker i
+  // is pinned to the i-th of those CPUs round-robin if pin_cpu
+  PreforkServer(std::string_view ip, uint16_t port, std::size_t worker_num,
+                WorkerFunc f, bool pin_cpu = true);
+  // SIGTERM and reap the workers still alive
+  ~PreforkServer();
+  // fork the workers and supervise them until all exited normally or Stop();
+  // call it while the process is single-threaded, a worker forked from a
+  // multithreaded process may find a lock held by a thread it lacks
+  void Run();
+  // async-signal-safe, workers are terminated instead of respawned
+  void Stop();
+  std::size_t WorkerNum() const { return workers_.size(); }
+  std::size_t Respawns() const { return respawns_; }
+
+ private:
+  void Spawn(std::size_t index);
+  void Reap(pid_t pid, int status);
+
+ private:
+  std::unique_ptr<TCPServer> server_;
+  WorkerFunc f_;
+  bool pin_cpu_ = true;
+  std::vector<int> cpus_;      // CPUs the master is allowed to run on
+  std::vector<pid_t> workers_;  // -1 while a slot has no live worker
+  std::size_t live_ = 0;
+  std::size_t respawns_ = 0;
+  pid_t master_pid_ = 0;
+  std::atomic<bool> is_running_ = false;
+};
+
+}  // namespace jc
@@ -0,0 +1,128 @@
+#include "net/resolver.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+namespace jc {
+
+Resolver& Resolver::Instance() {
+  static Resolver resolver;
+  return resolver;
+}
+
+std::optional<in_addr> Resolver::ResolveCached(std::string_view host) {
+  std::optional<in_addr> addr;
+  FindCached(std::string{host}, addr);
+  return addr;
+}
+
+std::optional<in_addr> Resolver::Resolve(std::string_view host) {
+  std::string name{host};
+  std::optional<in_addr> addr;
+  if (FindCached(name, addr)) {
+    return addr;
+  }
+  return Lookup(name);
+}
+
+Resolver::QueryID Resolver::ResolveAsync(std::string_view host, Callback f) {
+  std::string name{host};
+  std::optional<in_addr> addr;
+  if (FindCached(name, addr)) {
+    f(addr);
+    return 0;
+  }
+  QueryID id = 0;
+  {
+    std::lock_guard lock(queue_mutex_);
+    id = ++next_query_id_;
+    // a name stays queued while it has an entry, even one emptied by Cancel()
+    auto [it, is_new] = waiters_.try_emplace(name);
+    it->second.push_back({.id = id, .f = std::move(f)});
+    if (is_new) {
+      queries_.emplace_back(std::move(name));
+    }
+    if (!worker_.joinable()) {
+      worker_ = std::jthread{[this](std::stop_token stop_token) {
+        Run(stop_token);
+      }};
+    }
+  }
+  queue_cv_.notify_one();
+  return id;
+}
+
+void Resolver::Cancel(QueryID id) {
+  if (id == 0) {
+    return;
+  }
+  std::lock_guard callback_lock(callback_mutex_);
+  std::lock_guard lock(queue_mutex_);
+  for (auto& [name, waiters] : waiters_) {
+    if (std::erase_if(waiters, [id](const Waiter& w) { return w.id == id; })) {
+      return;
+    }
+  }
+}
+
+bool Resolver::FindCached(const std::string& host,
+                          std::optional<in_addr>& addr) {
+  in_addr numeric_addr;
+  if (::inet_pton(AF_INET, host.c_str(), &numeric_addr) == 1) {
+    addr = numeric_addr;
+    return true;
+  }
+  std::shared_lock lock(cache_mutex_);
+  auto it = cache_.find(host);
+  if (it == cache_.end() ||
+      it->second.expire_time <= std::chrono::steady_clock::now()) {
+    return false;
+  }
+  addr = it->second.addr;
+  return true;
+}
+
+std::optional<in_addr> Resolver::Lookup(const std::string& host) {
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  std::optional<in_addr> addr;
+  if (::getaddrinfo(host.c_str(), nullptr, &hints, &res) == 0 && res) {
+    addr = reinterpret_cast<sockaddr_in*>(res->ai_addr)->sin_addr;
+  }
+  if (res) {
+    ::freeaddrinfo(res);
+  }
+  auto ttl = std::chrono::milliseconds(addr ? ttl_millsec_
+                                            : negative_ttl_millsec_);
+  std::unique_lock lock(cache_mutex_);
+  cache_[host] = {addr, std::chrono::steady_clock::now() + ttl};
+  return addr;
+}
+
+void Resolver::Run(std::stop_token stop_token) {
+  while (true) {
+    std::string name;
+    {
+      std::unique_lock lock(queue_mutex_);
+      if (!queue_cv_.wait(lock, stop_token, [&] { return !queries_.empty(); })) {
+        return;
+      }
+      name = std::move(queries_.front());
+      queries_.pop_front();
+    }
+    std::optional<in_addr> addr = Lookup(name);
+    std::lock_guard callback_lock(callback_mutex_);
+    std::vector<Waiter> waiters;
+    {
+      std::lock_guard lock(queue_mutex_);
+      waiters = std::move(waiters_.extract(name).mapped());
+    }
+    for (Waiter& waiter : waiters) {
+      waiter.f(addr);
+    }
+  }
+}
+
+}  // namespace jc
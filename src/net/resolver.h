@@ -0,0 +1,95 @@
+#pragma once
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// process-wide IPv4 name resolution shared by all loops, numeric literals
+// are parsed in place, names are looked up with getaddrinfo and cached for
+// ttl_millsec_ (failures for negative_ttl_millsec_), asynchronous lookups run
+// on a worker thread and concurrent lookups of one name share a query
+class Resolver : noncopyable {
+ public:
+  using Callback = std::function<void(std::optional<in_addr>)>;
+  // 0 for a query answered inline
+  using QueryID = uint64_t;
+
+  static constexpr uint64_t ttl_millsec_ = 60 * 1000;
+  static constexpr uint64_t negative_ttl_millsec_ = 5 * 1000;
+
+  static Resolver& Instance();
+
+  // numeric literal or unexpired cache entry, never blocks, nullopt if the
+  // name is unknown or failed recently
+  std::optional<in_addr> ResolveCached(std::string_view host);
+  // blocks on getaddrinfo on a cache miss, keep it off loop threads
+  std::optional<in_addr> Resolve(std::string_view host);
+  // f runs inline on a fast path hit, otherwise on the worker thread
+  QueryID ResolveAsync(std::string_view host, Callback f);
+  // f runs in the loop thread of poller, the owner of poller cancels the
+  // query before destroying it, the worker would reach into it otherwise
+  template <typename Poller>
+  QueryID ResolveInLoop(Poller& poller, std::string_view host, Callback f);
+  // drop the callback of a pending query, a callback already running on the
+  // worker thread finishes first, so none runs once this returns; never
+  // call it from such a callback
+  void Cancel(QueryID id);
+
+ private:
+  struct Entry {
+    std::optional<in_addr> addr;
+    std::chrono::steady_clock::time_point expire_time;
+  };
+
+  struct Waiter {
+    QueryID id = 0;
+    Callback f;
+  };
+
+  Resolver() = default;
+  // true on a fast path hit, addr is nullopt for a cached failure
+  bool FindCached(const std::string& host, std::optional<in_addr>& addr);
+  std::optional<in_addr> Lookup(const std::string& host);
+  void Run(std::stop_token stop_token);
+
+ private:
+  std::shared_mutex cache_mutex_;
+  std::unordered_map<std::string, Entry> cache_;
+
+  // held by the worker while it runs callbacks, taken before queue_mutex_
+  std::mutex callback_mutex_;
+  std::mutex queue_mutex_;
+  std::condition_variable_any queue_cv_;
+  std::deque<std::string> queries_;
+  // callbacks waiting for each queued name
+  std::unordered_map<std::string, std::vector<Waiter>> waiters_;
+  QueryID next_query_id_ = 0;
+  std::jthread worker_;
+};
+
+template <typename Poller>
+inline Resolver::QueryID Resolver::ResolveInLoop(Poller& poller,
+                                                 std::string_view host,
+                                                 Callback f) {
+  return ResolveAsync(
+      host, [&poller, f = std::move(f)](std::optional<in_addr> addr) {
+        poller.RunInLoop([f, addr] { f(addr); });
+      });
+}
+
+}  // namespace jc
@@ -5,29 +5,34 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
 #include <cassert>
 #include <cstring>
+#include <optional>
 #include <string_view>
 #include <type_traits>
 #include <utility>
 
+#include "net/resolver.h"
+
 namespace jc {
 
-inline sockaddr_in resolve_socketaddr(std::string_view host, uint16_t port) {
-  hostent* he = ::gethostbyname(host.data());
-  if (!he) {
-    printf("failed to resolve: %s\n", host.data());
-    exit(1);
+// nullopt if host cannot be resolved, see Resolver for caching and the
+// non-blocking variants
+inline std::optional<sockaddr_in> resolve_socketaddr(std::string_view host,
+                                                     uint16_t port) {
+  std::optional<in_addr> addr = Resolver::Instance().Resolve(host);
+  if (!addr) {
+    return std::nullopt;
   }
-  assert(he->h_addrtype == AF_INET && he->h_length == sizeof(uint32_t));
   sockaddr_in res = {};
   res.sin_family = AF_INET;
   res.sin_port = ::htons(port);
-  res.sin_addr = *reinterpret_cast<in_addr*>(he->h_addr);
+  res.sin_addr = *addr;
   return res;
 }
 
@@ -56,6 +61,11 @@ inline bool socket_set_reuseaddr(int fd) {
   return !::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
 }
 
+inline bool socket_set_reuseport(int fd) {
+  int flag = 1;
+  return !::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+}
+
 inline bool socket_set_keepalive(int fd) {
   int flag = 1;
   return !::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(flag));
@@ -66,6 +76,51 @@ inline bool socket_disable_nagle(int fd) {
   return !::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
 }
 
+inline bool socket_set_recv_timeout(int fd, uint64_t millsec) {
+  timeval tv = {.tv_sec = static_cast<time_t>(millsec / 1000),
+                .tv_usec = static_cast<suseconds_t>(millsec % 1000 * 1000)};
+  return !::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// the kernel polls the device queue of fd for up to microsec in blocking
+// reads and epoll_wait instead of sleeping until the interrupt, values above
+// net.core.busy_read need CAP_NET_ADMIN
+inline bool socket_set_busy_poll(int fd, int microsec) {
+  return !::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &microsec,
+                       sizeof(microsec));
+}
+
+// let busy polling defer softirq processing of the queue instead of racing it
+inline bool socket_set_prefer_busy_poll(int fd) {
+  int flag = 1;
+  return !::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &flag,
+                       sizeof(flag));
+}
+
+// allow send with MSG_ZEROCOPY, completions arrive on the error queue
+inline bool socket_set_zerocopy(int fd) {
+  int flag = 1;
+  return !::setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &flag, sizeof(flag));
+}
+
+// send the tail held back by MSG_MORE, clearing TCP_CORK pushes pending
+// frames and nothing here sets it otherwise
+inline bool socket_push_pending(int fd) {
+  int flag = 0;
+  return !::setsockopt(fd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+}
+
+// close() then resets the connection and drops the data still queued
+inline bool socket_set_abortive_close(int fd) {
+  linger option = {.l_onoff = 1, .l_linger = 0};
+  return !::setsockopt(fd, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+}
+
+inline bool socket_set_udp_gro(int fd) {
+  int flag = 1;
+  return !::setsockopt(fd, IPPROTO_UDP, UDP_GRO, &flag, sizeof(flag));
+}
+
 inline bool socket_set_connect_retry_times(int fd, int n) {
   int flag = n;  // timeout is 2 ^ (n + 1) - 1 seconds
   return !::setsockopt(fd, IPPROTO_TCP, TCP_SYN_SENT, &flag, sizeof(flag));
@@ -95,7 +150,13 @@ inline int create_listen_fd(std::string_view ip, uint16_t port) {
     printf("failed to set_reuseaddr for fd=%d\n", fd);
     exit(1);
   }
-  sockaddr_in addr = resolve_socketaddr(ip.data(), port);
+  std::optional<sockaddr_in> resolved_addr = resolve_socketaddr(ip, port);
+  if (!resolved_addr) {
+    printf("failed to resolve: %.*s\n", static_cast<int>(ip.size()),
+           ip.data());
+    exit(1);
+  }
+  sockaddr_in addr = *resolved_addr;
   if (!socket_bind(fd, addr)) {
     printf("failed to bind addr=%s\n", sockaddr_to_ip_port(addr).c_str());
     exit(1);
@@ -112,12 +173,51 @@ inline int socket_accept(int fd, sockaddr_in& peer_addr) {
   return ::accept(fd, reinterpret_cast<sockaddr*>(&peer_addr), &peer_addr_len);
 }
 
+// flags such as SOCK_NONBLOCK and SOCK_CLOEXEC are applied to the accepted
+// fd atomically, saving the fcntl calls afterwards
+inline int socket_accept4(int fd, sockaddr_in& peer_addr, int flags) {
+  socklen_t peer_addr_len = sizeof(peer_addr);
+  return ::accept4(fd, reinterpret_cast<sockaddr*>(&peer_addr), &peer_addr_len,
+                   flags);
+}
+
 inline bool socket_connect(int fd, const sockaddr_in& addr) {
   socket_set_connect_retry_times(fd, 2);
   return ::connect(fd, reinterpret_cast<const sockaddr*>(&addr),
                    sizeof(addr)) != -1;
 }
 
+// return 0 once connected, or -1 with errno EINPROGRESS while the handshake
+// goes on in the background
+inline int socket_connect_nonblocking(int fd, const sockaddr_in& addr) {
+  return ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+// the pending error of fd, 0 if none, e.g. the result of a non-blocking
+// connect
+inline int socket_get_error(int fd) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+    return errno;
+  }
+  return err;
+}
+
+inline sockaddr_in socket_local_addr(int fd) {
+  sockaddr_in addr = {};
+  socklen_t addr_len = sizeof(addr);
+  ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+  return addr;
+}
+
+inline sockaddr_in socket_peer_addr(int fd) {
+  sockaddr_in addr = {};
+  socklen_t addr_len = sizeof(addr);
+  ::getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+  return addr;
+}
+
 inline bool socket_shutdown(int fd) { return ::shutdown(fd, SHUT_WR) >= 0; }
 
 inline uint16_t get_free_port() {
@@ -146,12 +246,24 @@ inline int create_epfd() {
   return fd;
 }
 
-inline bool epfd_add_read(int epfd, int fd) {
+// fd is expected to be non-blocking already
+inline bool epfd_add_read(int epfd, int fd, bool edge_triggered = false) {
   epoll_event ev;
   ev.data.fd = fd;
-  ev.events = EPOLLIN;
-  return ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != -1 &&
-         socket_set_nonblocking(fd);
+  ev.events = edge_triggered ? EPOLLIN | EPOLLET : EPOLLIN;
+  return ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != -1;
+}
+
+// fd is shared by the epfds of several processes or threads, e.g. a listen
+// fd, and a new event wakes only one of them instead of all; the
+// registration cannot be modified afterwards, only deleted
+inline bool epfd_add_read_exclusive(int epfd, int fd,
+                                    bool edge_triggered = false) {
+  epoll_event ev;
+  ev.data.fd = fd;
+  ev.events = edge_triggered ? EPOLLIN | EPOLLET | EPOLLEXCLUSIVE
+                             : EPOLLIN | EPOLLEXCLUSIVE;
+  return ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != -1;
 }
 
 inline bool epfd_add_write(int epfd, int fd) {
@@ -169,14 +281,20 @@ inline bool epfd_mod(int epfd, int fd, int op) {
   return ::epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) != -1;
 }
 
-inline bool epfd_mod_read(int epfd, int fd) {
-  return epfd_mod(epfd, fd, EPOLLIN);
+inline bool epfd_mod_read(int epfd, int fd, bool edge_triggered = false) {
+  return epfd_mod(epfd, fd, edge_triggered ? EPOLLIN | EPOLLET : EPOLLIN);
 }
 
 inline bool epfd_mod_write(int epfd, int fd) {
   return epfd_mod(epfd, fd, EPOLLOUT | EPOLLET);
 }
 
+inline bool epfd_mod_read_write(int epfd, int fd, bool edge_triggered = false) {
+  return epfd_mod(epfd, fd,
+                  edge_triggered ? EPOLLIN | EPOLLOUT | EPOLLET
+                                 : EPOLLIN | EPOLLOUT);
+}
+
 inline bool epfd_del(int epfd, int fd) {
   return ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr) != -1;
 }
@@ -0,0 +1,57 @@
+#include "net/task_queue.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace jc {
+
+TaskQueue::TaskQueue() {
+  efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd_ == -1) {
+    printf("failed to create eventfd\n");
+    exit(1);
+  }
+}
+
+TaskQueue::~TaskQueue() { ::close(efd_); }
+
+void TaskQueue::Push(std::function<void()> f) {
+  bool was_empty = false;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    was_empty = tasks_.empty();
+    tasks_.emplace_back(std::move(f));
+  }
+  if (was_empty) {
+    Wakeup();
+  }
+}
+
+void TaskQueue::Wakeup() const {
+  uint64_t one = 1;
+  if (::write(efd_, &one, sizeof(one)) != sizeof(one)) {
+    printf("write eventfd error\n");
+  }
+}
+
+std::size_t TaskQueue::OnWakeup() {
+  // consume the wakeup before taking the batch, a task pushed after the swap
+  // then finds the queue empty and writes the eventfd again
+  uint64_t howmany;
+  [[maybe_unused]] ssize_t n = ::read(efd_, &howmany, sizeof(howmany));
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    running_tasks_.swap(tasks_);
+  }
+  for (auto& f : running_tasks_) {
+    f();
+  }
+  std::size_t tasks = running_tasks_.size();
+  running_tasks_.clear();
+  return tasks;
+}
+
+}  // namespace jc
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// tasks posted to an event loop from any thread, the loop registers FD() and
+// runs the whole batch in OnWakeup(), the eventfd is only written when the
+// queue turns non-empty so a burst of posts costs one wakeup
+class TaskQueue : noncopyable {
+ public:
+  TaskQueue();
+  ~TaskQueue();
+  constexpr int FD() const { return efd_; }
+  void Push(std::function<void()> f);
+  void Wakeup() const;
+  // return the number of tasks run
+  std::size_t OnWakeup();
+
+ private:
+  int efd_ = -1;
+  std::mutex mutex_;
+  std::vector<std::function<void()>> tasks_;
+  std::vector<std::function<void()>> running_tasks_;
+};
+
+}  // namespace jc
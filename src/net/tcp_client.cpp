@@ -7,6 +7,16 @@ namespace jc {
 TCPClient::TCPClient(std::string_view peer_ip, uint16_t peer_port,
                      std::string_view local_ip, uint16_t local_port)
     : peer_addr_(peer_ip, peer_port), local_addr_(local_ip, local_port) {
+  if (!peer_addr_.IsValid()) {
+    printf("failed to resolve: %.*s\n", static_cast<int>(peer_ip.size()),
+           peer_ip.data());
+    exit(1);
+  }
+  if (!local_addr_.IsValid()) {
+    printf("failed to resolve: %.*s\n", static_cast<int>(local_ip.size()),
+           local_ip.data());
+    exit(1);
+  }
   fd_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   if (fd_ == -1) {
     printf("failed to create tcp socket fd\n");
@@ -18,15 +28,20 @@ TCPClient::TCPClient(std::string_view peer_ip, uint16_t peer_port,
   }
 }
 
-TCPClient::~TCPClient() { ::close(fd_); }
+TCPClient::~TCPClient() {
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
 
-std::unique_ptr<TCPConnection> TCPClient::Connect() const {
+std::unique_ptr<TCPConnection> TCPClient::Connect() {
   if (!socket_connect(fd_, peer_addr_.SocketAddr())) {
     printf("failed to connect %s to %s\n", local_addr_.IPPort().c_str(),
            peer_addr_.IPPort().c_str());
     return nullptr;
   }
-  return std::make_unique<TCPConnection>(fd_, local_addr_.SocketAddr(),
+  return std::make_unique<TCPConnection>(std::exchange(fd_, -1),
+                                         local_addr_.SocketAddr(),
                                          peer_addr_.SocketAddr());
 }
 
@@ -15,7 +15,8 @@ class TCPClient : noncopyable {
             std::string_view local_ip = "localhost", uint16_t local_port = 0);
   ~TCPClient();
   constexpr int FD() const { return fd_; }
-  std::unique_ptr<TCPConnection> Connect() const;
+  // blocking connect, the returned connection takes over the fd
+  std::unique_ptr<TCPConnection> Connect();
 
  private:
   int fd_ = -1;
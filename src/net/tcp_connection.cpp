@@ -1,27 +1,177 @@
 #include "net/tcp_connection.h"
 
+#include <algorithm>
+
 namespace jc {
 
 TCPConnection::TCPConnection(int fd, const IPAddr& local_addr,
-                             const IPAddr& peer_addr)
+                             const IPAddr& peer_addr, bool set_options)
     : fd_(fd), local_addr_(local_addr), peer_addr_(peer_addr) {
-  socket_disable_nagle(fd_);
-  socket_set_keepalive(fd_);
+  if (set_options) {
+    socket_disable_nagle(fd_);
+    socket_set_keepalive(fd_);
+  }
 }
 
 TCPConnection::~TCPConnection() {
-  Shutdown();
+  if (output_queue_.ZeroCopyInFlight() != 0) {
+    output_queue_.ReapZeroCopy(fd_);
+  }
+  // the kernel still reads the pages of zero-copy sends not reported
+  // complete, including a payload sent in part, the reset drops them from
+  // the send queue before the output queue releases them
+  if (output_queue_.ZeroCopyInFlight() != 0) {
+    socket_set_abortive_close(fd_);
+  } else {
+    Shutdown();
+  }
   ::close(fd_);
 }
 
 int TCPConnection::Send(char* data, std::size_t len) const {
-  return ::send(fd_, data, len, 0);
+  int n = ::send(fd_, data, len, 0);
+  metrics_.OnSend(n);
+  return n;
+}
+
+int TCPConnection::SendAll(const char* data, std::size_t len) const {
+  std::size_t sent = 0;
+  while (sent < len) {
+    int n = ::send(fd_, data + sent, len - sent, 0);
+    metrics_.OnSend(n);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return -1;
+    }
+    sent += n;
+  }
+  return sent;
 }
 
 int TCPConnection::Recv(char* data, std::size_t len) const {
-  return ::recv(fd_, data, len, 0);
+  int n = ::recv(fd_, data, len, 0);
+  metrics_.OnRecv(n);
+  return n;
 }
 
 void TCPConnection::Shutdown() const { socket_shutdown(fd_); }
 
+int TCPConnection::RecvToBuffer() {
+  int n = input_buffer_.ReadFD(fd_);
+  metrics_.OnRecv(n);
+  return n;
+}
+
+int TCPConnection::SendBuffered(std::string_view data) {
+  int sent = 0;
+  if (output_queue_.Empty()) {
+    sent = SendAll(data.data(), data.size());
+    if (sent == -1) {
+      return -1;
+    }
+  }
+  if (static_cast<std::size_t>(sent) < data.size()) {
+    output_queue_.Append(data.substr(sent));
+    OnOutputChanged();
+  }
+  return sent;
+}
+
+bool TCPConnection::SendDeferred(std::string_view data) {
+  bool was_empty = output_queue_.Empty();
+  output_queue_.Append(data);
+  return was_empty;
+}
+
+ssize_t TCPConnection::SendFile(int fd, off_t offset, std::size_t len) {
+  bool was_empty = output_queue_.Empty();
+  output_queue_.AppendFile(fd, offset, len);
+  ssize_t sent = was_empty ? WriteOutput() : 0;
+  OnOutputChanged();
+  return sent;
+}
+
+ssize_t TCPConnection::Splice(int pipe_fd, std::size_t len) {
+  bool was_empty = output_queue_.Empty();
+  output_queue_.AppendPipe(pipe_fd, len);
+  ssize_t sent = was_empty ? WriteOutput() : 0;
+  OnOutputChanged();
+  return sent;
+}
+
+bool TCPConnection::EnableZeroCopy(std::size_t min_size) {
+  if (!socket_set_zerocopy(fd_)) {
+    return false;
+  }
+  zerocopy_min_size_ = std::max<std::size_t>(min_size, 1);
+  return true;
+}
+
+ssize_t TCPConnection::SendZeroCopy(std::string_view data,
+                                    std::function<void()> release) {
+  if (data.size() < zerocopy_min_size_) {
+    int sent = SendBuffered(data);
+    release();
+    return sent;
+  }
+  bool was_empty = output_queue_.Empty();
+  output_queue_.AppendZeroCopy(data, std::move(release));
+  ssize_t sent = was_empty ? WriteOutput() : 0;
+  OnOutputChanged();
+  return sent;
+}
+
+void TCPConnection::OnErrorQueue() {
+  bool copied = false;
+  output_queue_.ReapZeroCopy(fd_, &copied);
+  // the route cannot avoid the copy, e.g. loopback, stop paying for the
+  // page pinning and completions
+  if (copied) {
+    zerocopy_min_size_ = SIZE_MAX;
+  }
+}
+
+ssize_t TCPConnection::FlushBuffer() {
+  ssize_t sent = WriteOutput();
+  OnOutputChanged();
+  return sent;
+}
+
+void TCPConnection::OnOutputChanged() {
+  // deferred output is queued silently, so compare with what the callback
+  // was told last instead of with the queue before the change
+  bool has_output = !output_queue_.Empty();
+  if (has_output != is_write_interested_) {
+    is_write_interested_ = has_output;
+    if (write_interest_callback_) {
+      write_interest_callback_(has_output);
+    }
+  }
+  std::size_t size = output_queue_.Size();
+  if (!is_above_high_water_mark_ && size >= high_water_mark_) {
+    is_above_high_water_mark_ = true;
+    if (high_water_mark_callback_) {
+      high_water_mark_callback_(size);
+    }
+  } else if (is_above_high_water_mark_ && size <= low_water_mark_) {
+    is_above_high_water_mark_ = false;
+    if (low_water_mark_callback_) {
+      low_water_mark_callback_(size);
+    }
+  }
+}
+
+ssize_t TCPConnection::WriteOutput() {
+  std::size_t syscalls = 0;
+  ssize_t sent = output_queue_.WriteFD(
+      fd_, ConnectionMetrics::enabled_ ? &syscalls : nullptr);
+  metrics_.OnSend(sent, syscalls);
+  return sent;
+}
+
 }  // namespace jc
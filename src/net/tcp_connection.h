@@ -1,28 +1,127 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <string>
 
 #include "base/noncopyable.h"
+#include "base/object_pool.h"
+#include "net/buffer.h"
 #include "net/ip_addr.h"
+#include "net/metrics.h"
+#include "net/output_queue.h"
 #include "net/socket_utils.h"
 
 namespace jc {
 
 class TCPConnection : noncopyable {
  public:
-  TCPConnection(int fd, const IPAddr& local_addr, const IPAddr& peer_addr);
+  // below this size pinning pages and reaping the completion cost more than
+  // the copy they save
+  static constexpr std::size_t zerocopy_threshold_ = 16 * 1024;
+
+  // set_options is false when fd already has TCP_NODELAY and SO_KEEPALIVE,
+  // e.g. inherited from a listen fd
+  TCPConnection(int fd, const IPAddr& local_addr, const IPAddr& peer_addr,
+                bool set_options = true);
   ~TCPConnection();
+  // connections are recycled through per-thread slots instead of malloc
+  static void* operator new(std::size_t) {
+    return ObjectPool<TCPConnection>::Allocate();
+  }
+  static void operator delete(void* p) {
+    ObjectPool<TCPConnection>::Deallocate(p);
+  }
   constexpr int FD() const { return fd_; }
   constexpr const IPAddr& LocalAddr() const { return local_addr_; }
   constexpr const IPAddr& PeerAddr() const { return peer_addr_; }
   int Send(char* data, std::size_t len) const;
+  // keep sending until all data is written or the socket buffer is full,
+  // return the number of bytes written or -1 on error
+  int SendAll(const char* data, std::size_t len) const;
   int Recv(char* data, std::size_t len) const;
   void Shutdown() const;
 
+  // bytes and syscalls so far, empty unless built with SNET_METRICS
+  const ConnectionMetrics& Metrics() const { return metrics_; }
+  Buffer& InputBuffer() { return input_buffer_; }
+  bool HasPendingOutput() const { return !output_queue_.Empty(); }
+  std::size_t PendingOutputBytes() const { return output_queue_.Size(); }
+  // append whatever the socket holds to InputBuffer()
+  int RecvToBuffer();
+  // send data directly if nothing is pending, queue the unsent rest to be
+  // written by FlushBuffer() once the fd is writable
+  int SendBuffered(std::string_view data);
+  // send len bytes of fd starting at offset with sendfile, the kernel moves
+  // the pages straight to the socket; fd must stay open until
+  // HasPendingOutput() turns false
+  ssize_t SendFile(int fd, off_t offset, std::size_t len);
+  // move len bytes already in pipe_fd to the socket with splice
+  ssize_t Splice(int pipe_fd, std::size_t len);
+  // let SendZeroCopy() use MSG_ZEROCOPY for payloads of at least min_size
+  // bytes, false if the kernel lacks SO_ZEROCOPY
+  bool EnableZeroCopy(std::size_t min_size = zerocopy_threshold_);
+  // send data in order with the rest of the output without copying it into
+  // the socket buffer, data must stay valid until release runs once the
+  // kernel is done with its pages, see OnErrorQueue(); smaller payloads, or
+  // all of them if zero-copy is off or the kernel reported copying anyway,
+  // take the copying path and are released before this returns. A
+  // connection destroyed while PendingZeroCopy() is not 0 resets the peer to
+  // get the pages back, keep it until then for the data to be delivered
+  ssize_t SendZeroCopy(std::string_view data, std::function<void()> release);
+  // reap zero-copy completions, the owner calls it whenever the poller
+  // reports an error on the fd, e.g. EPOLLERR passed to OnError()
+  void OnErrorQueue();
+  // zero-copy payloads sent but not released yet
+  std::size_t PendingZeroCopy() const {
+    return output_queue_.ZeroCopyInFlight();
+  }
+  // queue data without writing it, so the replies of one loop iteration go
+  // out in one gathered write at its end; return true if nothing was pending
+  // before, the caller then has to call FlushBuffer() itself, otherwise the
+  // pending output is already waiting for the fd to become writable
+  bool SendDeferred(std::string_view data);
+  // write queued bytes and transfers in order until the socket is full
+  ssize_t FlushBuffer();
+
+  // called with true when output starts queuing and with false once it is
+  // drained, the owner turns write interest on and off accordingly
+  void SetWriteInterestCallback(std::function<void(bool)> f) {
+    write_interest_callback_ = std::move(f);
+  }
+  // f runs once the pending output grows to mark bytes
+  void SetHighWaterMarkCallback(std::function<void(std::size_t)> f,
+                                std::size_t mark) {
+    high_water_mark_callback_ = std::move(f);
+    high_water_mark_ = mark;
+  }
+  // f runs once the pending output drains back to mark bytes after the high
+  // water mark was hit
+  void SetLowWaterMarkCallback(std::function<void(std::size_t)> f,
+                               std::size_t mark) {
+    low_water_mark_callback_ = std::move(f);
+    low_water_mark_ = mark;
+  }
+
+ private:
+  void OnOutputChanged();
+  ssize_t WriteOutput();
+
  private:
   int fd_ = -1;
   IPAddr local_addr_ = {};
   IPAddr peer_addr_ = {};
+  Buffer input_buffer_;
+  OutputQueue output_queue_;
+  std::function<void(bool)> write_interest_callback_;
+  std::function<void(std::size_t)> high_water_mark_callback_;
+  std::function<void(std::size_t)> low_water_mark_callback_;
+  std::size_t high_water_mark_ = 64 * 1024 * 1024;
+  std::size_t low_water_mark_ = 0;
+  bool is_above_high_water_mark_ = false;
+  bool is_write_interested_ = false;  // last told to the callback
+  std::size_t zerocopy_min_size_ = SIZE_MAX;  // SIZE_MAX if disabled
+  [[no_unique_address]] mutable ConnectionMetrics metrics_;
 };
 
 }  // namespace jc
@@ -4,7 +4,12 @@
 
 namespace jc {
 
-TCPServer::TCPServer(std::string_view ip, uint16_t port) : addr_(ip, port) {
+TCPServer::TCPServer(std::string_view ip, uint16_t port, bool reuse_port)
+    : addr_(ip, port) {
+  if (!addr_.IsValid()) {
+    printf("failed to resolve: %.*s\n", static_cast<int>(ip.size()), ip.data());
+    exit(1);
+  }
   fd_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   if (fd_ == -1) {
     printf("failed to create tcp socket fd\n");
@@ -14,6 +19,14 @@ TCPServer::TCPServer(std::string_view ip, uint16_t port) : addr_(ip, port) {
     printf("failed to set_reuseaddr for fd=%d\n", fd_);
     exit(1);
   }
+  if (reuse_port && !socket_set_reuseport(fd_)) {
+    printf("failed to set_reuseport for fd=%d\n", fd_);
+    exit(1);
+  }
+  if (!socket_disable_nagle(fd_) || !socket_set_keepalive(fd_)) {
+    printf("failed to set socket options for fd=%d\n", fd_);
+    exit(1);
+  }
   if (!socket_bind(fd_, addr_.SocketAddr())) {
     printf("failed to bind addr=%s\n", addr_.IPPort().c_str());
     exit(1);
@@ -28,13 +41,52 @@ TCPServer::~TCPServer() { ::close(fd_); }
 
 std::unique_ptr<TCPConnection> TCPServer::Accept() const {
   sockaddr_in peer_addr;
-  int conn_fd = socket_accept(fd_, peer_addr);
+  int conn_fd = Accept(peer_addr, SOCK_CLOEXEC);
   if (conn_fd == -1) {
+    return nullptr;
+  }
+  return std::make_unique<TCPConnection>(conn_fd, IPAddr(peer_addr),
+                                         addr_.SocketAddr(), false);
+}
+
+std::size_t TCPServer::AcceptBatch(
+    std::vector<std::unique_ptr<TCPConnection>>& connections,
+    std::size_t max_batch_size) const {
+  std::size_t n = 0;
+  sockaddr_in peer_addr;
+  while (n < max_batch_size) {
+    int conn_fd = Accept(peer_addr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn_fd == -1) {
+      break;
+    }
+    connections.emplace_back(std::make_unique<TCPConnection>(
+        conn_fd, IPAddr(peer_addr), addr_.SocketAddr(), false));
+    ++n;
+  }
+  return n;
+}
+
+std::unique_ptr<TCPConnection> TCPServer::Adopt(int conn_fd) const {
+  return std::make_unique<TCPConnection>(
+      conn_fd, IPAddr(socket_peer_addr(conn_fd)), addr_.SocketAddr(), false);
+}
+
+int TCPServer::Accept(sockaddr_in& peer_addr, int flags) const {
+  while (true) {
+    int conn_fd = socket_accept4(fd_, peer_addr, flags);
+    if (conn_fd != -1) {
+      return conn_fd;
+    }
+    // the peer reset before it was accepted, move on to the next one
+    if (errno == EINTR || errno == ECONNABORTED) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return -1;
+    }
     printf("failed to accept addr=%s\n", addr_.IPPort().c_str());
     exit(1);
   }
-  return std::make_unique<TCPConnection>(conn_fd, IPAddr(peer_addr),
-                                         addr_.SocketAddr());
 }
 
 }  // namespace jc
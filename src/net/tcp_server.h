@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "base/noncopyable.h"
 #include "net/ip_addr.h"
@@ -9,13 +10,31 @@
 
 namespace jc {
 
+// TCP_NODELAY and SO_KEEPALIVE are set once on the listen fd, accepted fds
+// inherit them, so accepting costs no setsockopt
 class TCPServer : noncopyable {
  public:
-  TCPServer(std::string_view ip, uint16_t port);
+  static constexpr std::size_t max_batch_size_ = 64;
+
+  TCPServer(std::string_view ip, uint16_t port, bool reuse_port = false);
   ~TCPServer();
+  // return nullptr if the listen fd is non-blocking and no connection is ready
   std::unique_ptr<TCPConnection> Accept() const;
+  // accept up to max_batch_size non-blocking connections into connections
+  // until the backlog is drained, a result below max_batch_size means EAGAIN
+  // was seen, so an edge-triggered listen fd need not be accepted again
+  std::size_t AcceptBatch(
+      std::vector<std::unique_ptr<TCPConnection>>& connections,
+      std::size_t max_batch_size = max_batch_size_) const;
+  // wrap conn_fd accepted on FD() elsewhere, e.g. by an io_uring multishot
+  // accept that reports no peer address, which costs one getpeername
+  std::unique_ptr<TCPConnection> Adopt(int conn_fd) const;
   constexpr int FD() const { return fd_; }
 
+ private:
+  // return the accepted fd, -1 on EAGAIN
+  int Accept(sockaddr_in& peer_addr, int flags) const;
+
  private:
   int fd_ = -1;
   IPAddr addr_ = {};
@@ -0,0 +1,273 @@
+#include "net/timing_wheel.h"
+
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace jc {
+
+namespace {
+
+uint64_t monotonic_nanosec() {
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace
+
+TimingWheel::TimingWheel(uint64_t tick_millsec)
+    : tick_nanosec_(std::max<uint64_t>(tick_millsec, 1) * 1000000),
+      start_nanosec_(monotonic_nanosec()) {
+  tfd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (tfd_ == -1) {
+    printf("failed to create timerfd\n");
+    exit(1);
+  }
+  heads_.fill(npos_);
+}
+
+TimingWheel::~TimingWheel() { ::close(tfd_); }
+
+TimingWheel::TimerID TimingWheel::Add(const std::function<void()>& f,
+                                      uint64_t millsec,
+                                      uint64_t interval_millsec) {
+  if (!f) {
+    return 0;
+  }
+  uint32_t idx = free_head_;
+  if (idx == npos_) {
+    idx = nodes_.size();
+    nodes_.emplace_back();
+  } else {
+    free_head_ = nodes_[idx].next;
+  }
+  if (size_ == 0 && !is_expiring_) {
+    current_ = NowTick();  // nothing to cascade, skip the idle ticks
+  }
+  Node& node = nodes_[idx];
+  node.cb = f;
+  node.expire = TicksFromNow(millsec);
+  node.interval =
+      interval_millsec == 0
+          ? 0
+          : (interval_millsec * 1000000 + tick_nanosec_ - 1) / tick_nanosec_;
+  node.active = true;
+  ++size_;
+  Insert(idx);
+  return (static_cast<uint64_t>(node.generation) << 32) | idx;
+}
+
+bool TimingWheel::Cancel(TimerID id) {
+  Node* node = Find(id);
+  if (!node) {
+    return false;
+  }
+  uint32_t idx = static_cast<uint32_t>(id);
+  if (node->slot != npos_) {
+    Unlink(idx);
+  }
+  Free(idx);
+  return true;
+}
+
+bool TimingWheel::Reset(TimerID id, uint64_t millsec) {
+  Node* node = Find(id);
+  if (!node) {
+    return false;
+  }
+  uint32_t idx = static_cast<uint32_t>(id);
+  if (node->slot != npos_) {
+    Unlink(idx);
+  }
+  node->expire = TicksFromNow(millsec);
+  Insert(idx);
+  return true;
+}
+
+uint64_t TimingWheel::OnTimer() {
+  uint64_t howmany;
+  // may be EAGAIN if the timer was re-armed after it fired
+  [[maybe_unused]] ssize_t n = ::read(tfd_, &howmany, sizeof(howmany));
+  const uint64_t now_nanosec = monotonic_nanosec();
+  const uint64_t deadline = start_nanosec_ + armed_ * tick_nanosec_;
+  const uint64_t lag = armed_ != UINT64_MAX && now_nanosec > deadline
+                           ? now_nanosec - deadline
+                           : 0;
+  armed_ = UINT64_MAX;
+  is_expiring_ = true;
+  const uint64_t now = (now_nanosec - start_nanosec_) / tick_nanosec_;
+  while (current_ < now) {
+    ++current_;
+    if ((current_ & root_mask_) == 0) {
+      for (int i = 0; i < levels_; ++i) {
+        uint64_t index =
+            (current_ >> (root_bits_ + i * level_bits_)) & level_mask_;
+        Cascade(root_size_ + i * level_size_ + index);
+        if (index != 0) {
+          break;
+        }
+      }
+    }
+    Cascade(current_ & root_mask_);
+    Expire();
+  }
+  is_expiring_ = false;
+  if (size_ != 0) {
+    Arm(NextTick());
+  }
+  return lag;
+}
+
+uint64_t TimingWheel::NowTick() const {
+  return (monotonic_nanosec() - start_nanosec_) / tick_nanosec_;
+}
+
+uint64_t TimingWheel::TicksFromNow(uint64_t millsec) const {
+  // round up so a timer never fires before it is due
+  return (monotonic_nanosec() - start_nanosec_ + millsec * 1000000 +
+          tick_nanosec_ - 1) /
+         tick_nanosec_;
+}
+
+TimingWheel::Node* TimingWheel::Find(TimerID id) {
+  uint32_t idx = static_cast<uint32_t>(id);
+  if (idx >= nodes_.size()) {
+    return nullptr;
+  }
+  Node& node = nodes_[idx];
+  if (!node.active || node.generation != (id >> 32)) {
+    return nullptr;
+  }
+  return &node;
+}
+
+uint32_t TimingWheel::SlotOf(uint64_t expire) const {
+  uint64_t delta = expire - current_;
+  if (delta < root_size_) {
+    return expire & root_mask_;
+  }
+  int i = 0;
+  while (delta >= (uint64_t{1} << (root_bits_ + (i + 1) * level_bits_))) {
+    ++i;
+  }
+  return root_size_ + i * level_size_ +
+         ((expire >> (root_bits_ + i * level_bits_)) & level_mask_);
+}
+
+void TimingWheel::Insert(uint32_t idx) {
+  Node& node = nodes_[idx];
+  node.expire = std::clamp(node.expire, current_ + 1, current_ + max_ticks_ - 1);
+  Link(idx, SlotOf(node.expire));
+  if (!is_expiring_ && node.expire < armed_) {
+    Arm(node.expire);
+  }
+}
+
+void TimingWheel::Link(uint32_t idx, uint32_t slot) {
+  Node& node = nodes_[idx];
+  node.slot = slot;
+  node.prev = npos_;
+  node.next = heads_[slot];
+  if (node.next != npos_) {
+    nodes_[node.next].prev = idx;
+  }
+  heads_[slot] = idx;
+}
+
+void TimingWheel::Unlink(uint32_t idx) {
+  Node& node = nodes_[idx];
+  if (node.prev != npos_) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    heads_[node.slot] = node.next;
+  }
+  if (node.next != npos_) {
+    nodes_[node.next].prev = node.prev;
+  }
+  node.prev = npos_;
+  node.next = npos_;
+  node.slot = npos_;
+}
+
+void TimingWheel::Free(uint32_t idx) {
+  Node& node = nodes_[idx];
+  node.cb = nullptr;
+  node.active = false;
+  ++node.generation;
+  node.next = free_head_;
+  free_head_ = idx;
+  --size_;
+}
+
+void TimingWheel::Cascade(uint32_t slot) {
+  uint32_t idx = heads_[slot];
+  heads_[slot] = npos_;
+  while (idx != npos_) {
+    uint32_t next = nodes_[idx].next;
+    // timers due now go to the expired list, the rest to a lower wheel
+    Link(idx, nodes_[idx].expire <= current_ ? expired_slot_
+                                             : SlotOf(nodes_[idx].expire));
+    idx = next;
+  }
+}
+
+void TimingWheel::Expire() {
+  while (heads_[expired_slot_] != npos_) {
+    uint32_t idx = heads_[expired_slot_];
+    Unlink(idx);
+    // the callback may add, cancel or reset timers and reallocate nodes_, so
+    // keep the callable on the stack and look the node up again afterwards
+    uint32_t generation = nodes_[idx].generation;
+    std::function<void()> cb = std::move(nodes_[idx].cb);
+    cb();
+    Node& node = nodes_[idx];
+    if (!node.active || node.generation != generation) {
+      continue;  // cancelled by the callback
+    }
+    if (node.slot != npos_) {
+      node.cb = std::move(cb);  // rescheduled by the callback
+      continue;
+    }
+    if (node.interval == 0) {
+      Free(idx);
+      continue;
+    }
+    node.cb = std::move(cb);
+    node.expire += node.interval;
+    if (node.expire <= current_) {
+      node.expire = current_ + node.interval;
+    }
+    Insert(idx);
+  }
+}
+
+uint64_t TimingWheel::NextTick() const {
+  // never sleep past the next cascade, it may bring earlier timers down from
+  // the upper wheels
+  const uint64_t cascade = ((current_ >> root_bits_) + 1) << root_bits_;
+  for (uint64_t tick = current_ + 1; tick < cascade; ++tick) {
+    if (heads_[tick & root_mask_] != npos_) {
+      return tick;
+    }
+  }
+  return cascade;
+}
+
+void TimingWheel::Arm(uint64_t tick) {
+  uint64_t nanosec = start_nanosec_ + tick * tick_nanosec_;
+  itimerspec ts = {};
+  ts.it_value.tv_sec = nanosec / 1000000000;
+  ts.it_value.tv_nsec = nanosec % 1000000000;
+  if (::timerfd_settime(tfd_, TFD_TIMER_ABSTIME, &ts, nullptr) == -1) {
+    printf("failed to set time for timerfd\n");
+    exit(1);
+  }
+  armed_ = tick;
+}
+
+}  // namespace jc
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "base/noncopyable.h"
+
+namespace jc {
+
+// hierarchical timing wheel driven by one timerfd, a 256-slot root wheel is
+// refilled from four 64-slot wheels, each slot is an intrusive list so insert,
+// cancel and reschedule are O(1), the timerfd is only armed for the next
+// non-empty root slot or the next cascade
+class TimingWheel : noncopyable {
+ public:
+  using TimerID = uint64_t;  // 0 is never a valid id
+
+  explicit TimingWheel(uint64_t tick_millsec = 1);
+  ~TimingWheel();
+  constexpr int FD() const { return tfd_; }
+  constexpr std::size_t Size() const { return size_; }
+
+  // run f after millsec, then every interval_millsec if it is not 0
+  TimerID Add(const std::function<void()>& f, uint64_t millsec,
+              uint64_t interval_millsec = 0);
+  bool Cancel(TimerID id);
+  // move the next expiry of id to millsec from now
+  bool Reset(TimerID id, uint64_t millsec);
+  // call when FD() is readable, run every timer that has expired, return
+  // how many nanosec the wheel fired after the deadline it was armed for
+  uint64_t OnTimer();
+
+ private:
+  static constexpr uint32_t npos_ = UINT32_MAX;
+  static constexpr int root_bits_ = 8;
+  static constexpr int level_bits_ = 6;
+  static constexpr int levels_ = 4;
+  static constexpr uint64_t root_size_ = 1 << root_bits_;
+  static constexpr uint64_t level_size_ = 1 << level_bits_;
+  static constexpr uint64_t root_mask_ = root_size_ - 1;
+  static constexpr uint64_t level_mask_ = level_size_ - 1;
+  static constexpr uint64_t max_ticks_ =
+      uint64_t{1} << (root_bits_ + levels_ * level_bits_);
+  static constexpr uint32_t expired_slot_ = root_size_ + levels_ * level_size_;
+
+  struct Node {
+    std::function<void()> cb;
+    uint64_t expire = 0;    // in ticks
+    uint64_t interval = 0;  // in ticks, 0 for one-shot timers
+    uint32_t prev = npos_;
+    uint32_t next = npos_;
+    uint32_t slot = npos_;  // the list the node is linked in
+    uint32_t generation = 1;
+    bool active = false;
+  };
+
+ private:
+  uint64_t NowTick() const;
+  uint64_t TicksFromNow(uint64_t millsec) const;
+  Node* Find(TimerID id);
+  uint32_t SlotOf(uint64_t expire) const;
+  void Insert(uint32_t idx);
+  void Link(uint32_t idx, uint32_t slot);
+  void Unlink(uint32_t idx);
+  void Free(uint32_t idx);
+  void Cascade(uint32_t slot);
+  void Expire();
+  uint64_t NextTick() const;
+  void Arm(uint64_t tick);
+
+ private:
+  int tfd_ = -1;
+  uint64_t tick_nanosec_ = 0;
+  uint64_t start_nanosec_ = 0;
+  uint64_t current_ = 0;  // the last tick processed
+  uint64_t armed_ = UINT64_MAX;
+  std::size_t size_ = 0;
+  bool is_expiring_ = false;
+  uint32_t free_head_ = npos_;
+  std::vector<Node> nodes_;
+  std::array<uint32_t, expired_slot_ + 1> heads_;
+};
+
+}  // namespace jc
@@ -1,5 +1,9 @@
 #include "net/udp_connection.h"
 
+#include <sys/socket.h>
+
+#include <algorithm>
+
 #include "net/socket_utils.h"
 
 namespace jc {
@@ -7,6 +11,11 @@ namespace jc {
 UDPConnection::UDPConnection(const IPAddr& local_addr, const IPAddr& peer_addr,
                              std::string_view nic)
     : local_addr_(local_addr), peer_addr_(peer_addr) {
+  // an IPAddr built from a name that failed to resolve is left invalid
+  if (!local_addr_.IsValid()) {
+    printf("failed to resolve local addr\n");
+    exit(1);
+  }
   fd_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
   if (fd_ == -1) {
     printf("failed to create udp socket fd\n");
@@ -42,4 +51,93 @@ std::pair<int, IPAddr> UDPConnection::Recv(char* data, std::size_t len) const {
   return std::make_pair(res, IPAddr{peer_addr});
 }
 
+int UDPConnection::SendBatch(UDPMessage* msgs, std::size_t n) const {
+  mmsghdr hdrs[max_batch_size_] = {};
+  iovec iovs[max_batch_size_];
+  char controls[max_batch_size_][CMSG_SPACE(sizeof(uint16_t))];
+  std::size_t sent = 0;
+  while (sent < n) {
+    std::size_t batch_size = std::min(n - sent, max_batch_size_);
+    for (std::size_t i = 0; i < batch_size; ++i) {
+      UDPMessage& msg = msgs[sent + i];
+      const sockaddr_in& addr = msg.addr.SocketAddr().sin_family == AF_UNSPEC
+                                    ? peer_addr_.SocketAddr()
+                                    : msg.addr.SocketAddr();
+      iovs[i] = {.iov_base = msg.data, .iov_len = msg.len};
+      msghdr& hdr = hdrs[i].msg_hdr;
+      hdr = {};
+      hdr.msg_name = const_cast<sockaddr_in*>(&addr);
+      hdr.msg_namelen = sizeof(addr);
+      hdr.msg_iov = &iovs[i];
+      hdr.msg_iovlen = 1;
+      if (msg.segment_size != 0 && msg.len > msg.segment_size) {
+        hdr.msg_control = controls[i];
+        hdr.msg_controllen = sizeof(controls[i]);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        std::memcpy(CMSG_DATA(cmsg), &msg.segment_size, sizeof(uint16_t));
+      }
+    }
+    int res = ::sendmmsg(fd_, hdrs, batch_size, 0);
+    if (res == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return sent > 0 ? sent : -1;
+    }
+    sent += res;
+    if (static_cast<std::size_t>(res) < batch_size) {
+      break;
+    }
+  }
+  return sent;
+}
+
+int UDPConnection::RecvBatch(UDPMessage* msgs, std::size_t n) const {
+  mmsghdr hdrs[max_batch_size_] = {};
+  iovec iovs[max_batch_size_];
+  sockaddr_in addrs[max_batch_size_];
+  char controls[max_batch_size_][CMSG_SPACE(sizeof(int))];
+  std::size_t batch_size = std::min(n, max_batch_size_);
+  for (std::size_t i = 0; i < batch_size; ++i) {
+    iovs[i] = {.iov_base = msgs[i].data, .iov_len = msgs[i].len};
+    msghdr& hdr = hdrs[i].msg_hdr;
+    hdr.msg_name = &addrs[i];
+    hdr.msg_namelen = sizeof(addrs[i]);
+    hdr.msg_iov = &iovs[i];
+    hdr.msg_iovlen = 1;
+    if (gro_enabled_) {
+      hdr.msg_control = controls[i];
+      hdr.msg_controllen = sizeof(controls[i]);
+    }
+  }
+  int res = ::recvmmsg(fd_, hdrs, batch_size, MSG_WAITFORONE, nullptr);
+  if (res == -1) {
+    return -1;
+  }
+  for (int i = 0; i < res; ++i) {
+    UDPMessage& msg = msgs[i];
+    msghdr& hdr = hdrs[i].msg_hdr;
+    msg.len = hdrs[i].msg_len;
+    msg.addr = addrs[i];
+    msg.segment_size = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg;
+         cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+      if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int segment_size = 0;
+        std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+        msg.segment_size = segment_size;
+      }
+    }
+  }
+  return res;
+}
+
+bool UDPConnection::EnableGRO() {
+  gro_enabled_ = socket_set_udp_gro(fd_);
+  return gro_enabled_;
+}
+
 }  // namespace jc
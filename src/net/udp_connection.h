@@ -8,21 +8,48 @@
 
 namespace jc {
 
+// one entry of a batch, data points to a caller-owned buffer of len bytes;
+// with segment_size set the buffer holds several datagrams of that size
+// back to back (the last one may be shorter), sent with UDP GSO or
+// received coalesced by UDP GRO
+struct UDPMessage {
+  char* data = nullptr;
+  std::size_t len = 0;
+  IPAddr addr = {};
+  uint16_t segment_size = 0;
+};
+
 class UDPConnection : noncopyable {
  public:
   UDPConnection(const IPAddr& local_addr, const IPAddr& peer_addr = {},
                 std::string_view nic = "");
   ~UDPConnection();
+  constexpr int FD() const { return fd_; }
   constexpr const IPAddr& LocalAddr() const { return local_addr_; }
   constexpr const IPAddr& PeerAddr() const { return peer_addr_; }
   int Send(char* data, std::size_t len, const IPAddr& peer_addr) const;
   int Send(char* data, std::size_t len) const;
   std::pair<int, IPAddr> Recv(char* data, std::size_t len) const;
 
+  // send msgs with sendmmsg, messages without an addr go to PeerAddr(),
+  // return the number of messages sent or -1 if none could be sent
+  int SendBatch(UDPMessage* msgs, std::size_t n) const;
+  // block until at least one datagram arrives and receive up to
+  // max_batch_size_ of them with one recvmmsg, len is the buffer capacity
+  // on input and the received length on output, return the number of
+  // messages filled or -1 on error
+  int RecvBatch(UDPMessage* msgs, std::size_t n) const;
+  // let the kernel coalesce consecutive datagrams of one flow, RecvBatch
+  // then reports their size in segment_size
+  bool EnableGRO();
+
+  static constexpr std::size_t max_batch_size_ = 64;
+
  private:
   int fd_ = -1;
   IPAddr local_addr_ = {};
   IPAddr peer_addr_ = {};
+  bool gro_enabled_ = false;
 };
 
 }  // namespace jc
@@ -0,0 +1,137 @@
+#include <signal.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// produces as fast as it is allowed to a slow reader, the water mark
+// callbacks pause and resume the producer so the pending output stays bounded
+template <std::size_t high_water_mark, std::size_t low_water_mark>
+class Producer : public PollerEpoll<Producer<high_water_mark, low_water_mark>> {
+ public:
+  Producer(uint16_t port, uint64_t timeout_millsec)
+      : server_("localhost", port), chunk_(chunk_size_, 'x') {
+    this->AddRead(server_.FD());
+    this->AddTimer([this] { Produce(); }, 1);
+    this->AddTimer([this] { this->Exit(); }, timeout_millsec);
+  }
+
+  void OnRead(int fd) {
+    if (fd != server_.FD() || connection_) {
+      return;
+    }
+    connection_ = server_.Accept();
+    if (!connection_) {
+      return;
+    }
+    int conn_fd = connection_->FD();
+    this->AddRead(conn_fd);
+    connection_->SetWriteInterestCallback([this, conn_fd](bool enable) {
+      enable ? this->SetReadWrite(conn_fd) : this->SetRead(conn_fd);
+    });
+    connection_->SetHighWaterMarkCallback(
+        [this](std::size_t pending) {
+          ++pause_cnt_;
+          is_paused_ = true;
+          printf("pause[%d] producer, pending=%zu\n", pause_cnt_, pending);
+        },
+        high_water_mark);
+    connection_->SetLowWaterMarkCallback(
+        [this](std::size_t pending) {
+          printf("resume[%d] producer, pending=%zu\n", pause_cnt_, pending);
+          is_paused_ = false;
+        },
+        low_water_mark);
+  }
+
+  void OnWrite(int fd) {
+    if (connection_ && connection_->FlushBuffer() == -1) {
+      CloseConnection();
+    }
+  }
+
+  bool Check() const {
+    printf("produced %zu bytes, paused %d times, max_pending=%zu\n",
+           produced_, pause_cnt_, max_pending_);
+    return pause_cnt_ > 0 && max_pending_ < high_water_mark + chunk_size_;
+  }
+
+ private:
+  void Produce() {
+    for (int i = 0; connection_ && !is_paused_ && i < 64; ++i) {
+      if (connection_->SendBuffered(chunk_) == -1) {
+        CloseConnection();
+        return;
+      }
+      produced_ += chunk_.size();
+      max_pending_ = std::max(max_pending_, connection_->PendingOutputBytes());
+    }
+  }
+
+  // the reader is gone
+  void CloseConnection() {
+    this->Remove(connection_->FD());
+    connection_.reset();
+  }
+
+ private:
+  static constexpr std::size_t chunk_size_ = 64 * 1024;
+
+ private:
+  TCPServer server_;
+  std::unique_ptr<TCPConnection> connection_;
+  std::string chunk_;
+  bool is_paused_ = false;
+  int pause_cnt_ = 0;
+  std::size_t produced_ = 0;
+  std::size_t max_pending_ = 0;
+};
+
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    Producer<4 << 20, 1 << 20> producer{port_, timeout_millsec};
+    std::jthread t{&Tester::run_client, this};
+    producer.Loop();
+    if (!producer.Check()) {
+      exit(1);
+    }
+  }
+
+ private:
+  void run_client() {
+    TCPClient client{"localhost", port_, "localhost", get_free_port()};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    // read about 64 MB/s, far slower than the producer
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_millsec - 200);
+    while (std::chrono::steady_clock::now() < deadline) {
+      if (connection->Recv(buf_, sizeof(buf_)) <= 0) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+ private:
+  char buf_[65536] = {};
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
@@ -0,0 +1,33 @@
+#include <signal.h>
+
+#include <thread>
+
+#include "net/poller_test.h"
+
+namespace jc {
+
+// the server spins before blocking, its exit timer must still fire and the
+// client must be served as with the blocking loop
+template <uint64_t timeout_millsec, uint64_t busy_poll_microsec>
+class Tester {
+ public:
+  void run() {
+    const uint16_t port_ = get_free_port();
+    std::jthread t{[&] {
+      PollerTCPServer<PollerEpoll>{
+          "localhost",
+          port_,
+          timeout_millsec,
+          {.busy_poll_microsec = busy_poll_microsec}};
+    }};
+    PollerTCPClient<PollerEpoll>{"localhost", port_, timeout_millsec};
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 50>{}.run();
+}
@@ -0,0 +1,156 @@
+#include <signal.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/fd_table.h"
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// replies to every line of a read on its own, either sent at once or
+// deferred and flushed in OnLoopEnd() as one write per connection
+class LineServer : public PollerEpoll<LineServer> {
+ public:
+  LineServer(TCPServer& server, bool coalesce_writes)
+      : server_(server), coalesce_writes_(coalesce_writes) {
+    AddRead(server_.FD());
+  }
+
+  void OnRead(int fd) {
+    if (fd == server_.FD()) {
+      auto connection = server_.Accept();
+      int conn_fd = connection->FD();
+      AddRead(conn_fd);
+      connection->SetWriteInterestCallback([this, conn_fd](bool enable) {
+        enable ? SetReadWrite(conn_fd) : SetRead(conn_fd);
+      });
+      connections_[conn_fd] = std::move(connection);
+      last_fd_ = conn_fd;
+      return;
+    }
+    auto& connection = connections_[fd];
+    int len = connection->RecvToBuffer();
+    if (len == 0 || (len == -1 && errno != EAGAIN)) {
+      Remove(fd);
+      connections_.Reset(fd);
+      return;
+    }
+    Buffer& input = connection->InputBuffer();
+    std::string_view data = input.View();
+    std::size_t consumed = 0;
+    for (std::size_t end; (end = data.find('\n', consumed)) !=
+                          std::string_view::npos;
+         consumed = end + 1) {
+      std::string_view line = data.substr(consumed, end + 1 - consumed);
+      if (!coalesce_writes_) {
+        connection->SendBuffered(line);
+      } else if (connection->SendDeferred(line)) {
+        deferred_fds_.push_back(fd);
+      }
+    }
+    input.Retrieve(consumed);
+  }
+
+  void OnWrite(int fd) {
+    if (auto& connection = connections_[fd]) {
+      connection->FlushBuffer();
+    }
+  }
+
+  void OnLoopEnd() {
+    for (int fd : deferred_fds_) {
+      if (auto& connection = connections_[fd]) {
+        connection->FlushBuffer();
+      }
+    }
+    deferred_fds_.clear();
+  }
+
+  // of the connection accepted last
+  uint64_t SendSyscalls() {
+    auto& connection = connections_[last_fd_];
+    return connection ? connection->Metrics().SendSyscalls() : 0;
+  }
+
+ private:
+  TCPServer& server_;
+  bool coalesce_writes_ = false;
+  FDTable<std::unique_ptr<TCPConnection>> connections_;
+  std::vector<int> deferred_fds_;
+  int last_fd_ = -1;
+};
+
+// the client writes line_num lines at once and waits for all replies, the
+// replies must arrive complete and in order in both modes
+template <uint64_t timeout_millsec, std::size_t line_num>
+class Tester {
+ public:
+  void run() {
+    for (bool coalesce_writes : {false, true}) {
+      uint16_t port = get_free_port();
+      TCPServer server{"localhost", port};
+      LineServer loop{server, coalesce_writes};
+      TCPClient client{"localhost", port};
+      auto connection = client.Connect();
+      if (!connection) {
+        exit(1);
+      }
+      uint64_t round_trips = 0;
+      {
+        std::jthread t{[&] { loop.Loop(); }};
+        round_trips = run_client(*connection);
+        loop.Exit();
+      }
+      printf("%s: %lu round trips of %zu lines in %lu ms",
+             coalesce_writes ? "coalesced" : "immediate", round_trips,
+             line_num, timeout_millsec / 2);
+      if constexpr (ConnectionMetrics::enabled_) {
+        printf(", server send syscalls per round trip %.2f",
+               1.0 * loop.SendSyscalls() / round_trips);
+      }
+      printf("\n");
+    }
+  }
+
+ private:
+  uint64_t run_client(TCPConnection& connection) {
+    socket_set_recv_timeout(connection.FD(), 1000);
+    std::string request;
+    for (std::size_t i = 0; i < line_num; ++i) {
+      request += "line" + std::to_string(i) + "\n";
+    }
+    uint64_t round_trips = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start <
+           std::chrono::milliseconds(timeout_millsec / 2)) {
+      connection.SendAll(request.data(), request.size());
+      Buffer& input = connection.InputBuffer();
+      while (input.ReadableBytes() < request.size()) {
+        if (connection.RecvToBuffer() <= 0) {
+          printf("replies are lost\n");
+          exit(1);
+        }
+      }
+      if (input.View() != request) {
+        printf("replies are out of order\n");
+        exit(1);
+      }
+      input.RetrieveAll();
+      ++round_trips;
+    }
+    return round_trips;
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 16>{}.run();
+}
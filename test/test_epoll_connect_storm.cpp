@@ -0,0 +1,127 @@
+#include <signal.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "net/connector.h"
+#include "net/poller_test.h"
+
+namespace jc {
+
+// brings up connection_num connections from one loop in parallel, then keeps
+// retrying a port nobody listens on until max_retries is exhausted
+class StormClient : public PollerEpoll<StormClient> {
+ public:
+  StormClient(uint16_t port, uint16_t closed_port, std::size_t connection_num)
+      : connection_num_(connection_num) {
+    start_ = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < connection_num_; ++i) {
+      connectors_.emplace_back(std::make_unique<Connector<StormClient>>(
+          *this, IPAddr{"localhost", port}, ConnectorOption{},
+          [this](std::unique_ptr<TCPConnection> connection) {
+            OnConnected(std::move(connection));
+          },
+          &connecting_));
+    }
+    for (auto& connector : connectors_) {
+      connector->Start();
+    }
+    refused_connector_ = std::make_unique<Connector<StormClient>>(
+        *this, IPAddr{"localhost", closed_port},
+        ConnectorOption{.initial_backoff_millsec = 50, .max_retries = 3},
+        [this](std::unique_ptr<TCPConnection> connection) {
+          OnRefused(std::move(connection));
+        },
+        &connecting_);
+    refused_connector_->Start();
+    AddTimer([this] { Exit(); }, 5000);
+  }
+
+  void OnRead(int fd) {}
+
+  void OnWrite(int fd) {
+    Connector<StormClient>** connector = connecting_.Find(fd);
+    if (connector && *connector) {
+      (*connector)->OnWrite();
+    }
+  }
+
+  bool Check() const {
+    return connections_.size() == connection_num_ && refused_attempts_ == 4;
+  }
+
+ private:
+  void OnConnected(std::unique_ptr<TCPConnection> connection) {
+    if (!connection) {
+      printf("failed to connect to the server\n");
+      exit(1);
+    }
+    connections_.emplace_back(std::move(connection));
+    if (connections_.size() % 200 == 0 ||
+        connections_.size() == connection_num_) {
+      printf("connected %zu connections in %ld ms\n", connections_.size(),
+             std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start_)
+                 .count());
+    }
+    MaybeExit();
+  }
+
+  void OnRefused(std::unique_ptr<TCPConnection> connection) {
+    if (connection) {
+      printf("connected to a port nobody listens on\n");
+      exit(1);
+    }
+    refused_attempts_ = refused_connector_->Attempts();
+    printf("gave up the closed port after %d attempts in %ld ms\n",
+           refused_attempts_,
+           std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start_)
+               .count());
+    MaybeExit();
+  }
+
+  void MaybeExit() {
+    if (connections_.size() == connection_num_ && refused_attempts_ != 0) {
+      Exit();
+    }
+  }
+
+ private:
+  std::size_t connection_num_ = 0;
+  std::chrono::steady_clock::time_point start_;
+  FDTable<Connector<StormClient>*> connecting_;
+  std::vector<std::unique_ptr<Connector<StormClient>>> connectors_;
+  std::unique_ptr<Connector<StormClient>> refused_connector_;
+  std::vector<std::unique_ptr<TCPConnection>> connections_;
+  int refused_attempts_ = 0;
+};
+
+template <uint64_t timeout_millsec, std::size_t connection_num>
+class Tester {
+ public:
+  void run() {
+    auto server = std::make_unique<TCPServer>("localhost", port_);
+    std::jthread t{[&] {
+      PollerTCPServer<PollerEpoll>{std::move(server), timeout_millsec,
+                                   {.edge_triggered = true, .echo = true}};
+    }};
+    StormClient client{port_, get_free_port(), connection_num};
+    client.Loop();
+    if (!client.Check()) {
+      exit(1);
+    }
+  }
+
+ private:
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 1000>{}.run();
+}
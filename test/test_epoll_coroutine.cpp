@@ -0,0 +1,95 @@
+#include <signal.h>
+
+#include <chrono>
+#include <string>
+
+#include "net/coroutine.h"
+#include "net/tcp_client.h"
+
+namespace jc {
+
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    CoroutineLoop loop;
+    CoroutineServer server{loop, "localhost", port_};
+    Serve(server);
+    Ping(loop);
+    Tick(loop);
+    loop.AddTimer([&] { loop.Exit(); }, timeout_millsec);
+    loop.Loop();
+    printf("%d round trips in %lu ms, %lu us per round trip\n", index_,
+           timeout_millsec, timeout_millsec * 1000 / std::max(index_, 1));
+    if (index_ == 0) {
+      exit(1);
+    }
+  }
+
+ private:
+  Task Serve(CoroutineServer& server) {
+    while (true) {
+      Echo(co_await server.Accept());
+    }
+  }
+
+  Task Echo(CoroutineConnection connection) {
+    char buf[1024];
+    while (true) {
+      ssize_t len = co_await connection.Recv(buf);
+      if (len <= 0) {
+        break;
+      }
+      if (co_await connection.SendAll({buf, static_cast<std::size_t>(len)}) ==
+          -1) {
+        break;
+      }
+    }
+  }
+
+  Task Ping(CoroutineLoop& loop) {
+    TCPClient client{"localhost", port_};
+    CoroutineConnection connection{loop, client.Connect()};
+    char buf[1024];
+    while (true) {
+      std::string msg = std::string{ping_msg_} + std::to_string(++index_);
+      if (co_await connection.SendAll(msg) == -1) {
+        exit(1);
+      }
+      ssize_t len = co_await connection.Recv(buf);
+      if (len <= 0) {
+        exit(1);
+      }
+      if (index_ % 10000 == 0) {
+        printf("connection[1] client[%s] recv from server[%s], msg[%zd]=%.*s\n",
+               connection.Connection().LocalAddr().IPPort().c_str(),
+               connection.Connection().PeerAddr().IPPort().c_str(), len,
+               static_cast<int>(len), buf);
+      }
+    }
+  }
+
+  Task Tick(CoroutineLoop& loop) {
+    for (int i = 1;; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      co_await loop.Sleep(500);
+      printf("tick[%d] slept %ld ms\n", i,
+             std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start)
+                 .count());
+    }
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  int index_ = 0;
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
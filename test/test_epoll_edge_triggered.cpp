@@ -0,0 +1,115 @@
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#include <string>
+#include <thread>
+
+#include "net/poller_epoll.h"
+#include "net/poller_test.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// reads read_size_ bytes per read, once per wakeup if level-triggered and
+// until EAGAIN if edge-triggered, and exits once expected bytes arrived
+class Reader : public PollerEpoll<Reader> {
+ public:
+  Reader(int fd, bool edge_triggered, std::size_t expected,
+         uint64_t timeout_millsec)
+      : edge_triggered_(edge_triggered), expected_(expected) {
+    AddRead(fd, edge_triggered);
+    AddTimer([&] { Exit(); }, timeout_millsec);
+  }
+
+  void OnRead(int fd) {
+    ++wakeups_;
+    do {
+      ssize_t len = ::recv(fd, buf_, sizeof(buf_), 0);
+      ++reads_;
+      if (len <= 0) {
+        break;
+      }
+      received_ += len;
+    } while (edge_triggered_);
+    if (received_ == expected_) {
+      Exit();
+    }
+  }
+
+  void OnWrite(int fd) {}
+
+  std::size_t Wakeups() const { return wakeups_; }
+  std::size_t Reads() const { return reads_; }
+  std::size_t Received() const { return received_; }
+
+ private:
+  static constexpr std::size_t read_size_ = 4096;
+  char buf_[read_size_] = {};
+  bool edge_triggered_ = false;
+  std::size_t expected_ = 0;
+  std::size_t wakeups_ = 0;
+  std::size_t reads_ = 0;
+  std::size_t received_ = 0;
+};
+
+template <uint64_t timeout_millsec, std::size_t payload_len>
+class Tester {
+ public:
+  void run() {
+    check_wakeups();
+    const uint16_t port_ = get_free_port();
+    std::jthread t{[&] {
+      PollerTCPServer<PollerEpoll>{"localhost", port_, timeout_millsec,
+                                   {.edge_triggered = true}};
+    }};
+    PollerTCPClient<PollerEpoll>{"localhost", port_, timeout_millsec};
+  }
+
+ private:
+  // the same payload, already queued on the socket, is read in both modes;
+  // edge-triggered must take all of it from a single wakeup while
+  // level-triggered is woken once per read
+  void check_wakeups() {
+    std::size_t wakeups[2] = {};
+    for (bool edge_triggered : {false, true}) {
+      uint16_t port = get_free_port();
+      TCPServer server{"localhost", port};
+      TCPClient client{"localhost", port};
+      auto peer = client.Connect();
+      auto connection = server.Accept();
+      if (!peer || !connection) {
+        exit(1);
+      }
+      socket_set_nonblocking(connection->FD());
+      std::string payload(payload_len, 'x');
+      peer->SendAll(payload.data(), payload.size());
+      for (int queued = 0; queued < static_cast<int>(payload_len);) {
+        ::ioctl(connection->FD(), FIONREAD, &queued);
+      }
+      Reader reader{connection->FD(), edge_triggered, payload_len,
+                    timeout_millsec};
+      reader.Loop();
+      printf("%s: %zu bytes in %zu wakeups, %zu reads\n",
+             edge_triggered ? "edge-triggered" : "level-triggered",
+             reader.Received(), reader.Wakeups(), reader.Reads());
+      if (reader.Received() != payload_len) {
+        printf("payload is not fully received\n");
+        exit(1);
+      }
+      wakeups[edge_triggered] = reader.Wakeups();
+    }
+    if (wakeups[1] != 1 || wakeups[1] >= wakeups[0]) {
+      printf("edge-triggered shows no fewer wakeups\n");
+      exit(1);
+    }
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 64 * 1024>{}.run();
+}
@@ -0,0 +1,123 @@
+#include <signal.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/length_codec.h"
+#include "net/poller_test.h"
+
+namespace jc {
+
+// frames must survive coalescing into one send and fragmentation into
+// single bytes for every length field, Encode refuses an oversized frame and
+// one sent anyway closes the connection
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    std::vector<std::jthread> threads;
+    for (auto length_field :
+         {LengthField::Fixed16, LengthField::Fixed32, LengthField::Varint}) {
+      LengthCodecOption option{.length_field = length_field,
+                               .max_frame_size = max_frame_size_};
+      uint16_t port = get_free_port();
+      auto server = std::make_unique<TCPServer>("localhost", port);
+      threads.emplace_back([option, s = std::move(server)]() mutable {
+        PollerTCPServer<PollerEpoll>{
+            std::move(s),
+            timeout_millsec,
+            {.edge_triggered = true, .echo = true, .framing = option}};
+      });
+      run_client(port, option);
+    }
+  }
+
+ private:
+  void run_client(uint16_t port, const LengthCodecOption& option) {
+    TCPClient client{"localhost", port};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    socket_set_recv_timeout(connection->FD(), 1000);
+    LengthCodec codec{option};
+    std::vector<std::string> frames;
+    Buffer output;
+    for (std::size_t size : {0, 1, 127, 128, 300, 16384, 32768}) {
+      frames.emplace_back(size, static_cast<char>('a' + frames.size()));
+      codec.Encode(frames.back(), output);
+    }
+    // all frames coalesced into one write
+    connection->SendAll(output.Peek(), output.ReadableBytes());
+    expect_frames(*connection, codec, frames, "coalesced");
+    // every byte in its own segment
+    output.RetrieveAll();
+    frames.resize(3);
+    for (const std::string& frame : frames) {
+      codec.Encode(frame, output);
+    }
+    for (std::size_t i = 0; i < output.ReadableBytes(); ++i) {
+      connection->SendAll(output.Peek() + i, 1);
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    expect_frames(*connection, codec, frames, "fragmented");
+    // Encode refuses what the peer's Decode would reject
+    output.RetrieveAll();
+    if (codec.Encode(std::string(max_frame_size_ + 1, 'x'), output) ||
+        output.ReadableBytes() != 0) {
+      printf("oversized frame is encoded\n");
+      exit(1);
+    }
+    // a length field beyond max_frame_size
+    codec = LengthCodec{{.length_field = option.length_field,
+                         .max_frame_size = UINT16_MAX}};
+    codec.Encode(std::string(max_frame_size_ + 1, 'x'), output);
+    connection->SendAll(output.Peek(), output.ReadableBytes());
+    char buf[16];
+    if (connection->Recv(buf, sizeof(buf)) != 0) {
+      printf("oversized frame is not rejected\n");
+      exit(1);
+    }
+    printf("oversized frame closed the connection\n");
+  }
+
+  void expect_frames(TCPConnection& connection, LengthCodec& codec,
+                     const std::vector<std::string>& frames,
+                     std::string_view name) {
+    std::size_t received = 0;
+    std::size_t batches = 0;
+    while (received < frames.size()) {
+      int len = connection.RecvToBuffer();
+      if (len <= 0) {
+        printf("%.*s frames are lost\n", static_cast<int>(name.size()),
+               name.data());
+        exit(1);
+      }
+      codec.Decode(connection.InputBuffer(), [&](auto batch) {
+        ++batches;
+        for (std::string_view frame : batch) {
+          if (received == frames.size() || frame != frames[received++]) {
+            printf("%.*s frame[%zu] mismatches\n",
+                   static_cast<int>(name.size()), name.data(), received);
+            exit(1);
+          }
+        }
+      });
+    }
+    printf("%zu %.*s frames echoed in %zu batches\n", frames.size(),
+           static_cast<int>(name.size()), name.data(), batches);
+  }
+
+ private:
+  static constexpr std::size_t max_frame_size_ = 32768;
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
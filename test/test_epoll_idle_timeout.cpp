@@ -0,0 +1,100 @@
+#include <signal.h>
+
+#include <chrono>
+#include <thread>
+
+#include "net/poller_test.h"
+#include "net/tcp_client.h"
+
+namespace jc {
+
+// one server closes a connection left idle, another one closes a connection
+// that stops in the middle of a frame
+template <uint64_t timeout_millsec, uint64_t idle_timeout_millsec,
+          uint64_t read_timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    std::jthread t{&Tester::run_client, this};
+    std::jthread read_server{[this] {
+      PollerTCPServer<PollerEpoll>{
+          "localhost", read_port_, timeout_millsec,
+          {.read_timeout_millsec = read_timeout_millsec,
+           .framing = LengthCodecOption{}}};
+    }};
+    std::jthread read_client{&Tester::run_read_client, this};
+    PollerTCPServer<PollerEpoll>{
+        "localhost", port_, timeout_millsec,
+        {.idle_timeout_millsec = idle_timeout_millsec}};
+  }
+
+ private:
+  void run_client() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    TCPClient client{"localhost", port_, "localhost", get_free_port()};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    // keep the connection busy for longer than the idle timeout
+    for (int i = 1; i <= 5; ++i) {
+      std::string msg = std::string{ping_msg_} + std::to_string(i);
+      connection->Send(const_cast<char*>(msg.c_str()), msg.size());
+      int len = connection->Recv(buf_, sizeof(buf_));
+      printf("connection[1] client[%s] recv from server[%s], msg[%d]=%.*s\n",
+             connection->LocalAddr().IPPort().c_str(),
+             connection->PeerAddr().IPPort().c_str(), len, len, buf_);
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(idle_timeout_millsec / 2));
+    }
+    auto start = std::chrono::steady_clock::now();
+    int len = connection->Recv(buf_, sizeof(buf_));
+    auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    printf("connection[1] recv %d after idle for %ld ms\n", len, idle.count());
+  }
+
+  void run_read_client() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    TCPClient client{"localhost", read_port_, "localhost", get_free_port()};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    LengthCodec codec;
+    Buffer frame;
+    codec.Encode(ping_msg_, frame);
+    connection->SendAll(frame.Peek(), frame.ReadableBytes());
+    if (connection->Recv(buf_, sizeof(buf_)) <= 0) {
+      printf("connection[1] got no reply to a whole frame\n");
+      exit(1);
+    }
+    // the header and half of the payload, the rest never comes
+    connection->SendAll(frame.Peek(), frame.ReadableBytes() - 2);
+    auto start = std::chrono::steady_clock::now();
+    int len = connection->Recv(buf_, sizeof(buf_));
+    auto stalled = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    printf("connection[1] recv %d after a partial frame for %ld ms\n", len,
+           stalled.count());
+    if (len != 0 ||
+        stalled < std::chrono::milliseconds(read_timeout_millsec - 10)) {
+      printf("partial frame is not closed by the read deadline\n");
+      exit(1);
+    }
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  char buf_[1024] = {};
+  const uint16_t port_ = get_free_port();
+  const uint16_t read_port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 500, 300>{}.run();
+}
@@ -0,0 +1,150 @@
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "net/mailbox.h"
+#include "net/poller_epoll.h"
+
+namespace jc {
+
+class EventLoop : public PollerEpoll<EventLoop> {
+ public:
+  void OnRead(int fd) { exit(1); }
+  void OnWrite(int fd) { exit(1); }
+};
+
+struct Message {
+  uint32_t producer = 0;
+  uint64_t seq = 0;
+};
+
+// the queues alone first, then producers post numbered messages to a mailbox
+// far smaller than the burst, so they yield on a full ring while the loop
+// drains it; every message must arrive once and in order per producer
+template <uint64_t timeout_millsec, std::size_t producer_num,
+          std::size_t capacity>
+class Tester {
+ public:
+  void run() {
+    check_spsc();
+    check_mpsc();
+    check_mailbox();
+  }
+
+ private:
+  void check_spsc() {
+    SPSCQueue<uint64_t> queue{capacity};
+    constexpr uint64_t message_num = 1000000;
+    std::jthread t{[&] {
+      for (uint64_t i = 0; i < message_num; ++i) {
+        while (!queue.TryPush(i)) {
+          std::this_thread::yield();
+        }
+      }
+    }};
+    for (uint64_t expected = 0; expected < message_num;) {
+      uint64_t value;
+      if (!queue.TryPop(value)) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (value != expected++) {
+        printf("spsc: popped %lu, expected %lu\n", value, expected - 1);
+        exit(1);
+      }
+    }
+    printf("spsc: %lu messages in order through %zu slots\n", message_num,
+           queue.Capacity());
+  }
+
+  void check_mpsc() {
+    MPSCQueue<Message> queue{capacity};
+    constexpr uint64_t message_num = 200000;
+    std::vector<std::jthread> producers;
+    for (std::size_t i = 0; i < producer_num; ++i) {
+      producers.emplace_back([&queue, i] {
+        for (uint64_t seq = 0; seq < message_num; ++seq) {
+          while (!queue.TryPush({static_cast<uint32_t>(i), seq})) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    std::vector<uint64_t> next(producer_num, 0);
+    for (uint64_t popped = 0; popped < producer_num * message_num;) {
+      Message message;
+      if (!queue.TryPop(message)) {
+        std::this_thread::yield();
+        continue;
+      }
+      ++popped;
+      if (message.seq != next[message.producer]++) {
+        printf("mpsc: producer[%u] message %lu is out of order\n",
+               message.producer, message.seq);
+        exit(1);
+      }
+    }
+    printf("mpsc: %zu producers, %lu messages in order\n", producer_num,
+           producer_num * message_num);
+  }
+
+  void check_mailbox() {
+    EventLoop loop;
+    Mailbox<Message> mailbox{capacity};
+    std::vector<uint64_t> next(producer_num, 0);
+    uint64_t received = 0;
+    auto on_message = [&](Message& message) {
+      if (message.seq != next[message.producer]++) {
+        printf("mailbox: producer[%u] message %lu is out of order\n",
+               message.producer, message.seq);
+        exit(1);
+      }
+      ++received;
+    };
+    loop.AddMailbox(mailbox, on_message);
+    std::atomic<uint64_t> posted = 0;
+    std::atomic<uint64_t> full = 0;
+    std::atomic<std::size_t> finished = 0;
+    std::vector<std::jthread> producers;
+    for (std::size_t i = 0; i < producer_num; ++i) {
+      producers.emplace_back([&, i] {
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_millsec);
+        for (uint64_t seq = 0; std::chrono::steady_clock::now() < deadline;
+             ++seq) {
+          while (!mailbox.Post({static_cast<uint32_t>(i), seq})) {
+            ++full;
+            std::this_thread::yield();
+          }
+          ++posted;
+        }
+        if (++finished == producer_num) {
+          // queued after the last post, the loop exits once woken for it
+          loop.QueueInLoop([&] { loop.Exit(); });
+        }
+      });
+    }
+    loop.Loop();
+    producers.clear();
+    // the exit task may run before the mailbox fd of the same wakeup
+    loop.RemoveMailbox(mailbox);
+    mailbox.Drain(on_message);
+    printf("mailbox: %zu producers posted %lu, received %lu, full %lu\n",
+           producer_num, posted.load(), received, full.load());
+    if (received != posted) {
+      printf("mailbox: %lu messages are lost\n", posted - received);
+      exit(1);
+    }
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<2000, 4, 1024>{}.run();
+}
@@ -0,0 +1,106 @@
+#include <signal.h>
+
+#include <chrono>
+#include <thread>
+
+#include "net/fd_table.h"
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+class EchoServer : public PollerEpoll<EchoServer> {
+ public:
+  explicit EchoServer(uint16_t port) : server_("localhost", port) {
+    AddRead(server_.FD());
+    AddTimer([] {}, 10);
+  }
+
+  void OnRead(int fd) {
+    if (fd == server_.FD()) {
+      server_.AcceptBatch(accepted_);
+      for (auto& connection : accepted_) {
+        AddNonBlockingRead(connection->FD());
+        connections_[connection->FD()] = std::move(connection);
+      }
+      accepted_.clear();
+      return;
+    }
+    std::unique_ptr<TCPConnection>& connection = connections_[fd];
+    int len = connection->RecvToBuffer();
+    if (len == 0 || (len == -1 && errno != EAGAIN)) {
+      Remove(fd);
+      connections_.Reset(fd);
+      return;
+    }
+    connection->SendBuffered(connection->InputBuffer().View());
+    connection->InputBuffer().RetrieveAll();
+  }
+
+  void OnWrite(int fd) {}
+
+ private:
+  TCPServer server_;
+  std::vector<std::unique_ptr<TCPConnection>> accepted_;
+  FDTable<std::unique_ptr<TCPConnection>> connections_;
+};
+
+// the loop runs in its own thread while this thread drives it and reads the
+// metrics without stopping it
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    if (!LoopMetrics::enabled_) {
+      printf("built without SNET_METRICS, run make METRICS=1\n");
+    }
+    uint16_t port = get_free_port();
+    EchoServer server{port};
+    std::jthread t{[&] { server.Loop(); }};
+    TCPClient client{"localhost", port};
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    char buf[64];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 1; std::chrono::steady_clock::now() - start <
+                    std::chrono::milliseconds(timeout_millsec);
+         ++i) {
+      server.QueueInLoop([] {});
+      connection->SendAll(ping_msg_.data(), ping_msg_.size());
+      if (connection->Recv(buf, sizeof(buf)) <= 0) {
+        exit(1);
+      }
+      if (i % 50000 == 0) {
+        printf("%s\n", server.Metrics().ToJSON().c_str());
+      }
+    }
+    printf("client connection %s\n", connection->Metrics().ToJSON().c_str());
+    if constexpr (LoopMetrics::enabled_) {
+      if (server.Metrics().ToJSON().find("\"wakeups\": 0,") !=
+              std::string::npos ||
+          connection->Metrics().BytesSent() !=
+              connection->Metrics().BytesReceived()) {
+        printf("metrics are not recorded\n");
+        exit(1);
+      }
+    }
+    std::string text = server.Metrics().ToPrometheus(R"(loop="0")");
+    printf("%s", text.substr(0, text.find("# TYPE", text.find("dispatch")))
+                     .c_str());
+    server.Exit();
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
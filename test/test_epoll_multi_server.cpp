@@ -0,0 +1,66 @@
+#include <signal.h>
+
+#include <chrono>
+#include <thread>
+
+#include "net/poller_test.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  // the client stops a while before the server times out, a connect
+  // attempted after the server is gone would fail the test
+  void run() {
+    std::jthread server{[this] {
+      PollerTCPMultiServer<PollerEpoll>{"localhost", port_, timeout_millsec, 4};
+    }};
+    run_client();
+  }
+
+ private:
+  void run_client() {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(timeout_millsec - 500);
+    int i = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+      TCPClient client{"localhost", port_, "localhost", get_free_port()};
+      auto connection = client.Connect();
+      if (!connection && i == 0) {
+        // the listen sockets are bound in the server thread
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      if (!connection) {
+        exit(1);
+      }
+      ++i;
+      std::string msg = std::string{ping_msg_} + std::to_string(i);
+      connection->Send(const_cast<char*>(msg.c_str()), msg.size());
+      int len = connection->Recv(buf_, sizeof(buf_));
+      if (len <= 0) {
+        printf("connection[%d] got no reply\n", i);
+        exit(1);
+      }
+      printf("connection[%d] client[%s] recv from server[%s], msg[%d]=%s\n", i,
+             connection->LocalAddr().IPPort().c_str(),
+             connection->PeerAddr().IPPort().c_str(), len, buf_);
+    }
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  char buf_[1024] = {};
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
@@ -0,0 +1,108 @@
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+
+#include "net/poller_test.h"
+#include "net/prefork_server.h"
+#include "net/tcp_client.h"
+
+namespace jc {
+
+// the first incarnation of worker 0 is killed by SIGALRM after crash_millsec,
+// the master must respawn it while the other workers keep serving; the
+// master runs in a process of its own that never had a second thread, the
+// client stays in this one
+template <uint64_t timeout_millsec, uint64_t crash_millsec,
+          std::size_t worker_num>
+class Tester {
+ public:
+  void run() {
+    using Clock = std::chrono::steady_clock;
+    const auto deadline =
+        Clock::now() + std::chrono::milliseconds(timeout_millsec);
+    PreforkServer prefork{
+        "localhost", port_, worker_num,
+        [&](std::unique_ptr<TCPServer> server, std::size_t index) {
+          printf("worker[%zu] pid=%d runs on cpu=%d\n", index, ::getpid(),
+                 ::sched_getcpu());
+          if (index == 0 && prefork.Respawns() == 0) {
+            ::alarm(crash_millsec / 1000);
+          }
+          auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline - Clock::now());
+          PollerTCPServer<PollerEpoll>{
+              std::move(server),
+              static_cast<uint64_t>(left.count()),
+              {.echo = true, .exclusive_accept = true}};
+        }};
+    // the port listens before the fork, the client never connects too early
+    fflush(stdout);
+    pid_t master = ::fork();
+    if (master == -1) {
+      printf("failed to fork master\n");
+      exit(1);
+    }
+    if (master == 0) {
+      prefork.Run();
+      printf("%zu workers, %zu respawned\n", prefork.WorkerNum(),
+             prefork.Respawns());
+      fflush(stdout);
+      ::_exit(prefork.Respawns() == 1 ? 0 : 1);
+    }
+    run_client(deadline);
+    int status = 0;
+    while (::waitpid(master, &status, 0) == -1 && errno == EINTR) {
+    }
+    printf("%zu pings served, %zu after the crash, %zu failed\n", served_,
+           served_after_crash_, failed_);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        served_after_crash_ == 0) {
+      printf("crashed worker is not respawned\n");
+      exit(1);
+    }
+  }
+
+ private:
+  void run_client(std::chrono::steady_clock::time_point deadline) {
+    const auto crash = deadline - std::chrono::milliseconds(timeout_millsec) +
+                       std::chrono::milliseconds(crash_millsec + 200);
+    char buf[sizeof(ping_msg_)];
+    while (std::chrono::steady_clock::now() + std::chrono::milliseconds(100) <
+           deadline) {
+      TCPClient client{"localhost", port_};
+      auto connection = client.Connect();
+      if (!connection) {
+        exit(1);
+      }
+      socket_set_recv_timeout(connection->FD(), 500);
+      connection->SendAll(ping_msg_.data(), ping_msg_.size());
+      if (connection->Recv(buf, sizeof(buf)) !=
+          static_cast<int>(ping_msg_.size())) {
+        ++failed_;
+        continue;
+      }
+      ++served_;
+      if (std::chrono::steady_clock::now() > crash) {
+        ++served_after_crash_;
+      }
+    }
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  const uint16_t port_ = get_free_port();
+  std::size_t served_ = 0;
+  std::size_t served_after_crash_ = 0;
+  std::size_t failed_ = 0;
+};
+
+}  // namespace jc
+
+int main() {
+  // SIGCHLD stays default, the master reaps its workers with waitpid
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 1000, 4>{}.run();
+}
@@ -0,0 +1,71 @@
+#include <signal.h>
+
+#include <chrono>
+#include <thread>
+
+#include "net/poller_epoll.h"
+
+namespace jc {
+
+class EventLoop : public PollerEpoll<EventLoop> {
+ public:
+  void OnRead(int fd) { exit(1); }
+  void OnWrite(int fd) { exit(1); }
+};
+
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  void run() {
+    check_early_exit();
+    EventLoop loop;
+    std::jthread t{[&] {
+      auto deadline = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(timeout_millsec);
+      while (std::chrono::steady_clock::now() < deadline) {
+        auto start = std::chrono::steady_clock::now();
+        loop.QueueInLoop([this, start] {
+          ++index_;
+          latency_ += std::chrono::steady_clock::now() - start;
+          if (index_ % 500 == 0) {
+            printf("index=%lu, average wakeup latency=%ld us\n", index_,
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       latency_)
+                           .count() /
+                       index_);
+          }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      // the loop has no timer and blocks until Exit wakes it up
+      loop.Exit();
+    }};
+    loop.Loop();
+  }
+
+ private:
+  // an Exit() made before Loop() is entered must still end it
+  void check_early_exit() {
+    EventLoop loop;
+    loop.Exit();
+    auto start = std::chrono::steady_clock::now();
+    loop.Loop();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed > std::chrono::milliseconds(timeout_millsec)) {
+      printf("Exit() before Loop() was lost\n");
+      exit(1);
+    }
+  }
+
+ private:
+  uint64_t index_ = 0;
+  std::chrono::steady_clock::duration latency_ = {};
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}
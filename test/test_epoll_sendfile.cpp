@@ -0,0 +1,214 @@
+#include <signal.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "net/fd_table.h"
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// serves header + file + middle + pipe payload to every connection, the
+// file and pipe bytes never pass through user space on the server side
+class FileServer : public PollerEpoll<FileServer> {
+ public:
+  FileServer(uint16_t port, int file_fd, std::size_t file_len,
+             uint64_t timeout_millsec)
+      : server_("localhost", port), file_fd_(file_fd), file_len_(file_len) {
+    AddRead(server_.FD());
+    AddTimer([&] { Exit(); }, timeout_millsec);
+  }
+
+  void OnRead(int fd) {
+    if (fd != server_.FD()) {
+      return;
+    }
+    auto connection = server_.Accept();
+    if (!connection) {
+      return;
+    }
+    int conn_fd = connection->FD();
+    AddRead(conn_fd);
+    int pipe_fds[2];
+    if (::pipe(pipe_fds) == -1) {
+      printf("failed to create pipe\n");
+      exit(1);
+    }
+    ::write(pipe_fds[1], pipe_msg_.data(), pipe_msg_.size());
+    connection->SendBuffered(header_msg_);
+    connection->SendFile(file_fd_, 0, file_len_);
+    connection->SendBuffered(middle_msg_);
+    connection->Splice(pipe_fds[0], pipe_msg_.size());
+    // the read end stays open until the splice is done
+    pipes_[conn_fd] = pipe_fds[0];
+    ::close(pipe_fds[1]);
+    connections_[conn_fd] = std::move(connection);
+    OnWrite(conn_fd);
+  }
+
+  void OnWrite(int fd) {
+    auto& connection = connections_[fd];
+    if (!connection) {
+      return;
+    }
+    if (connection->FlushBuffer() == -1) {
+      printf("failed to flush connection\n");
+      exit(1);
+    }
+    if (connection->HasPendingOutput()) {
+      SetWrite(fd);
+      return;
+    }
+    Remove(fd);
+    connections_.Reset(fd);
+    ::close(pipes_[fd]);
+  }
+
+  static constexpr std::string_view header_msg_ = "header:";
+  static constexpr std::string_view middle_msg_ = ":middle:";
+  static constexpr std::string_view pipe_msg_ = "pipe payload";
+
+ private:
+  TCPServer server_;
+  int file_fd_ = -1;
+  std::size_t file_len_ = 0;
+  FDTable<std::unique_ptr<TCPConnection>> connections_;
+  FDTable<int> pipes_;
+};
+
+template <uint64_t timeout_millsec, std::size_t file_len>
+class Tester {
+ public:
+  void run() {
+    char path[] = "/tmp/snet_sendfile_XXXXXX";
+    int file_fd = ::mkstemp(path);
+    if (file_fd == -1) {
+      printf("failed to create temp file\n");
+      exit(1);
+    }
+    ::unlink(path);
+    std::string content(file_len, '\0');
+    for (std::size_t i = 0; i < file_len; ++i) {
+      content[i] = 'a' + i % 26;
+    }
+    if (::write(file_fd, content.data(), content.size()) !=
+        static_cast<ssize_t>(content.size())) {
+      printf("failed to write temp file\n");
+      exit(1);
+    }
+    check_short_transfer(file_fd, false);
+    check_short_transfer(file_fd, true);
+    expected_ = std::string{FileServer::header_msg_} + content +
+                std::string{FileServer::middle_msg_} +
+                std::string{FileServer::pipe_msg_};
+
+    is_running_ = true;
+    std::jthread t{&Tester::run_client, this};
+    {
+      // closing the server resets connections still waiting in the backlog
+      FileServer server{port_, file_fd, file_len, timeout_millsec};
+      server.Loop();
+      is_running_ = false;
+    }
+    t.join();
+    ::close(file_fd);
+  }
+
+ private:
+  // the header is corked with MSG_MORE as a transfer follows, a file shorter
+  // than requested or a pipe whose writer is gone writes nothing, the header
+  // must still go out right away although the connection stays open
+  void check_short_transfer(int file_fd, bool is_pipe) {
+    TCPServer server{"localhost", port_};
+    TCPClient client{"localhost", port_, "localhost", get_free_port()};
+    auto peer = client.Connect();
+    auto connection = server.Accept();
+    if (!peer || !connection) {
+      exit(1);
+    }
+    int pipe_fds[2];
+    if (::pipe(pipe_fds) == -1) {
+      printf("failed to create pipe\n");
+      exit(1);
+    }
+    ::close(pipe_fds[1]);
+    socket_set_recv_timeout(peer->FD(), 1000);
+    auto start = std::chrono::steady_clock::now();
+    connection->SendDeferred(FileServer::header_msg_);
+    if (is_pipe) {
+      connection->Splice(pipe_fds[0], 4096);
+    } else {
+      connection->SendFile(file_fd, file_len, 4096);
+    }
+    if (connection->FlushBuffer() == -1 || connection->HasPendingOutput()) {
+      printf("failed to flush header before short transfer\n");
+      exit(1);
+    }
+    int len = peer->Recv(buf_, sizeof(buf_));
+    auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    ::close(pipe_fds[0]);
+    const char* kind = is_pipe ? "pipe" : "file";
+    if (std::string_view{buf_, static_cast<std::size_t>(std::max(len, 0))} !=
+            FileServer::header_msg_ ||
+        cost >= 100) {
+      printf("header before short %s stuck, got %d bytes in %ld ms\n", kind,
+             len, cost);
+      exit(1);
+    }
+    printf("header before short %s received in %ld ms\n", kind, cost);
+  }
+
+  void run_client() {
+    int i = 0;
+    while (is_running_) {
+      TCPClient client{"localhost", port_, "localhost", get_free_port()};
+      auto connection = client.Connect();
+      if (!connection) {
+        continue;
+      }
+      ++i;
+      auto start = std::chrono::steady_clock::now();
+      std::string received;
+      while (true) {
+        int len = connection->Recv(buf_, sizeof(buf_));
+        if (len <= 0) {
+          break;
+        }
+        received.append(buf_, len);
+      }
+      auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+      if (!is_running_) {
+        break;
+      }
+      if (received != expected_) {
+        printf("connection[%d] received %zu bytes, expected %zu bytes\n", i,
+               received.size(), expected_.size());
+        exit(1);
+      }
+      printf("connection[%d] received %zu bytes in %ld us, %.1f MB/s\n", i,
+             received.size(), cost,
+             static_cast<double>(received.size()) / std::max(cost, 1L));
+    }
+  }
+
+ private:
+  char buf_[65536] = {};
+  std::string expected_;
+  std::atomic<bool> is_running_ = false;
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 8 << 20>{}.run();
+}
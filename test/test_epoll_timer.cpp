@@ -33,12 +33,28 @@ class Tester {
         },
         500);
     timer.AddTimer([&] { printf("index=%ld\n", index_); }, 100);
+    // a deadline slid from its own callback, the way connection deadlines
+    // are refreshed, must keep its callback for the next expiry
+    Timer::TimerID deadline = 0;
+    deadline = timer.RunAfter(
+        [&] {
+          if (++slides_ < slide_num_) {
+            timer.ResetTimer(deadline, 50);
+          }
+        },
+        50);
     timer.Loop();
+    printf("deadline slid %lu times\n", slides_);
+    if (slides_ != slide_num_) {
+      exit(1);
+    }
   }
 
  private:
   uint64_t index_ = 0;
   uint64_t millsec_ = 0;
+  static constexpr uint64_t slide_num_ = 5;
+  uint64_t slides_ = 0;
 };
 
 }  // namespace jc
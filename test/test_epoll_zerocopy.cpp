@@ -0,0 +1,246 @@
+#include <signal.h>
+
+#include <atomic>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net/fd_table.h"
+#include "net/poller_epoll.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// serves a small header and payload_num large payloads taken from a pool of
+// buffers, a buffer returns to the pool only from its release callback; the
+// connection is closed once the output is written and every zero-copy send
+// is released
+class ZeroCopyServer : public PollerEpoll<ZeroCopyServer> {
+ public:
+  ZeroCopyServer(uint16_t port, std::vector<std::string*>& free_buffers,
+                 std::size_t payload_num, uint64_t timeout_millsec)
+      : server_("localhost", port),
+        free_buffers_(free_buffers),
+        payload_num_(payload_num) {
+    AddRead(server_.FD());
+    AddTimer([&] { Exit(); }, timeout_millsec);
+  }
+
+  static std::string Payload(std::size_t len) {
+    std::string payload(len, '\0');
+    for (std::size_t i = 0; i < len; ++i) {
+      payload[i] = 'a' + i % 26;
+    }
+    return payload;
+  }
+
+  void OnRead(int fd) {
+    if (fd != server_.FD()) {
+      return;
+    }
+    auto connection = server_.Accept();
+    if (!connection) {
+      return;
+    }
+    int conn_fd = connection->FD();
+    AddRead(conn_fd);
+    if (!connection->EnableZeroCopy()) {
+      printf("SO_ZEROCOPY is not supported, payloads are copied\n");
+    }
+    // small, always copied
+    connection->SendZeroCopy(header_msg_, [] {});
+    for (std::size_t i = 0; i < payload_num_; ++i) {
+      if (free_buffers_.empty()) {
+        printf("a released buffer is still referenced by the kernel\n");
+        exit(1);
+      }
+      std::string* buffer = free_buffers_.back();
+      free_buffers_.pop_back();
+      is_sending_ = true;
+      connection->SendZeroCopy(*buffer, [this, buffer] {
+        is_sending_ ? ++released_at_once_ : ++released_later_;
+        free_buffers_.push_back(buffer);
+      });
+      is_sending_ = false;
+    }
+    connections_[conn_fd] = std::move(connection);
+    OnWrite(conn_fd);
+  }
+
+  void OnWrite(int fd) {
+    auto& connection = connections_[fd];
+    if (!connection) {
+      return;
+    }
+    if (connection->FlushBuffer() == -1) {
+      printf("failed to flush connection\n");
+      exit(1);
+    }
+    if (connection->HasPendingOutput()) {
+      SetWrite(fd);
+      return;
+    }
+    CloseIfDone(fd);
+  }
+
+  void OnError(int fd) {
+    auto& connection = connections_[fd];
+    if (!connection) {
+      return;
+    }
+    connection->OnErrorQueue();
+    CloseIfDone(fd);
+  }
+
+  void PrintStats() const {
+    printf("payloads released at once[%zu], after completion[%zu]\n",
+           released_at_once_, released_later_);
+  }
+
+  static constexpr std::string_view header_msg_ = "header:";
+
+ private:
+  void CloseIfDone(int fd) {
+    auto& connection = connections_[fd];
+    if (connection->HasPendingOutput() ||
+        connection->PendingZeroCopy() != 0) {
+      return;
+    }
+    Remove(fd);
+    connections_.Reset(fd);
+  }
+
+ private:
+  TCPServer server_;
+  std::vector<std::string*>& free_buffers_;
+  std::size_t payload_num_ = 0;
+  bool is_sending_ = false;
+  std::size_t released_at_once_ = 0;
+  std::size_t released_later_ = 0;
+  FDTable<std::unique_ptr<TCPConnection>> connections_;
+};
+
+template <uint64_t timeout_millsec, std::size_t payload_len,
+          std::size_t payload_num>
+class Tester {
+ public:
+  void run() {
+    check_partial_send();
+    expected_ = std::string{ZeroCopyServer::header_msg_};
+    for (std::size_t i = 0; i < payload_num; ++i) {
+      expected_ += ZeroCopyServer::Payload(payload_len);
+    }
+    std::vector<std::string> buffers(payload_num * 2,
+                                     ZeroCopyServer::Payload(payload_len));
+    std::vector<std::string*> free_buffers;
+    for (std::string& buffer : buffers) {
+      free_buffers.push_back(&buffer);
+    }
+    is_running_ = true;
+    std::jthread t{&Tester::run_client, this};
+    {
+      // connections still open release their payloads when destroyed
+      ZeroCopyServer server{port_, free_buffers, payload_num,
+                            timeout_millsec};
+      server.Loop();
+      is_running_ = false;
+      server.PrintStats();
+    }
+    t.join();
+    if (free_buffers.size() != buffers.size()) {
+      printf("%zu of %zu zero-copy buffers are leaked\n",
+             buffers.size() - free_buffers.size(), buffers.size());
+      exit(1);
+    }
+  }
+
+ private:
+  // a connection destroyed while a payload is only partly sent to a peer
+  // that does not read must reset the peer, a graceful close would release
+  // the payload while the kernel still sends from its pages
+  void check_partial_send() {
+    TCPServer server{"localhost", port_};
+    TCPClient client{"localhost", port_};
+    auto peer = client.Connect();
+    auto connection = server.Accept();
+    if (!peer || !connection) {
+      exit(1);
+    }
+    if (!connection->EnableZeroCopy()) {
+      printf("SO_ZEROCOPY is not supported, partial send is not checked\n");
+      return;
+    }
+    socket_set_nonblocking(connection->FD());
+    int sndbuf = 4096;
+    ::setsockopt(connection->FD(), SOL_SOCKET, SO_SNDBUF, &sndbuf,
+                 sizeof(sndbuf));
+    std::string payload = ZeroCopyServer::Payload(16 * 1024 * 1024);
+    int released = 0;
+    connection->SendZeroCopy(payload, [&] { ++released; });
+    if (!connection->HasPendingOutput() || connection->PendingZeroCopy() != 1) {
+      printf("partly sent payload is not in flight\n");
+      exit(1);
+    }
+    connection.reset();
+    if (released != 1) {
+      printf("partly sent payload is released %d times\n", released);
+      exit(1);
+    }
+    socket_set_recv_timeout(peer->FD(), 1000);
+    int len = 0;
+    while ((len = peer->Recv(buf_, sizeof(buf_))) > 0) {
+    }
+    if (len != -1 || errno != ECONNRESET) {
+      printf("partly sent payload is closed gracefully\n");
+      exit(1);
+    }
+    printf("partly sent payload reset the peer\n");
+  }
+
+  void run_client() {
+    int i = 0;
+    while (is_running_) {
+      TCPClient client{"localhost", port_, "localhost", get_free_port()};
+      auto connection = client.Connect();
+      if (!connection) {
+        continue;
+      }
+      ++i;
+      std::string received;
+      while (true) {
+        int len = connection->Recv(buf_, sizeof(buf_));
+        if (len <= 0) {
+          break;
+        }
+        received.append(buf_, len);
+      }
+      if (!is_running_) {
+        break;
+      }
+      if (received != expected_) {
+        printf("connection[%d] received %zu bytes, expected %zu bytes\n", i,
+               received.size(), expected_.size());
+        exit(1);
+      }
+      if (i % 100 == 0) {
+        printf("connection[%d] received %zu bytes\n", i, received.size());
+      }
+    }
+  }
+
+ private:
+  char buf_[65536] = {};
+  std::string expected_;
+  std::atomic<bool> is_running_ = false;
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 256 * 1024, 4>{}.run();
+}
@@ -0,0 +1,83 @@
+#include <signal.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "net/tcp_connection.h"
+
+namespace jc {
+
+// churns connections and their buffers the way short-lived connections do,
+// freed slots must be reused and the pooled path must beat plain malloc
+template <std::size_t round_num, std::size_t live_num>
+class Tester {
+ public:
+  void run() {
+    check_reuse();
+    check_cross_thread();
+    auto malloc_cost = churn<std::allocator<char>>();
+    auto pool_cost = churn<PoolAllocator<char>>();
+    printf("churn of %zu buffers, malloc costs %ld ns, pool costs %ld ns\n",
+           round_num * live_num, malloc_cost / (round_num * live_num),
+           pool_cost / (round_num * live_num));
+  }
+
+ private:
+  void check_reuse() {
+    void* addr = nullptr;
+    for (int i = 0; i < 3; ++i) {
+      int fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      auto connection = std::make_unique<TCPConnection>(
+          fd, IPAddr{"127.0.0.1", 0}, IPAddr{"127.0.0.1", 0}, false);
+      connection->InputBuffer().Append("ping");
+      if (addr && addr != connection.get()) {
+        printf("connection slot is not reused\n");
+        exit(1);
+      }
+      addr = connection.get();
+    }
+    printf("connection of %zu bytes reuses slot %p\n", sizeof(TCPConnection),
+           addr);
+  }
+
+  // slots freed by another thread are handed out by that thread
+  void check_cross_thread() {
+    std::vector<Buffer> buffers(live_num);
+    std::jthread t{[&] {
+      buffers.clear();
+      Buffer buffer;
+      buffer.Append("pong");
+      printf("buffer freed and allocated again in thread %s\n",
+             buffer.RetrieveAllAsString().c_str());
+    }};
+  }
+
+  template <typename Allocator>
+  int64_t churn() {
+    using Storage = std::vector<char, Allocator>;
+    std::vector<Storage> live(live_num);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < round_num; ++i) {
+      for (auto& storage : live) {
+        storage = Storage(Buffer::cheap_prepend_ + Buffer::initial_size_);
+        storage[0] = static_cast<char>(i);
+      }
+      for (auto& storage : live) {
+        Storage{}.swap(storage);
+      }
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<1000, 1000>{}.run();
+}
@@ -0,0 +1,157 @@
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <cerrno>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "net/poller_epoll.h"
+#include "net/resolver.h"
+#include "net/tcp_client.h"
+
+namespace jc {
+
+class EventLoop : public PollerEpoll<EventLoop> {
+ public:
+  void OnRead(int fd) { exit(1); }
+  void OnWrite(int fd) { exit(1); }
+};
+
+// every loop resolves the same names concurrently, completions must come
+// back in the loop thread and repeated names must hit the cache
+template <std::size_t loop_num, std::size_t lookup_num>
+class Tester {
+ public:
+  void run() {
+    check_unresolved();
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < loop_num; ++i) {
+      threads.emplace_back(&Tester::run_loop, this, i);
+    }
+    threads.clear();
+    measure_cached();
+    check_cancel();
+  }
+
+ private:
+  // a client for a name that does not resolve must fail loudly instead of
+  // connecting to 0.0.0.0:0, it runs in a child forked before any thread
+  void check_unresolved() {
+    ::signal(SIGCHLD, SIG_DFL);
+    fflush(stdout);
+    pid_t pid = ::fork();
+    if (pid == -1) {
+      printf("failed to fork\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      TCPClient client{"unresolved.invalid", 80};
+      ::_exit(0);
+    }
+    int status = 0;
+    while (::waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+    }
+    ::signal(SIGCHLD, SIG_IGN);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 1) {
+      printf("unresolved name is not reported\n");
+      exit(1);
+    }
+  }
+
+  void run_loop(std::size_t index) {
+    EventLoop loop;
+    std::size_t done = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto on_done = [&](std::string_view host, bool expect_success,
+                       std::optional<in_addr> addr) {
+      if (!loop.IsInLoopThread() || addr.has_value() != expect_success) {
+        printf("loop[%zu] unexpected result for %.*s\n", index,
+               static_cast<int>(host.size()), host.data());
+        exit(1);
+      }
+      if (++done == lookup_num * 3) {
+        printf("loop[%zu] resolved %zu names in %ld us\n", index, done,
+               std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count());
+        loop.Exit();
+      }
+    };
+    for (std::size_t i = 0; i < lookup_num; ++i) {
+      for (auto [host, expect_success] :
+           {std::pair{"127.0.0.1", true}, std::pair{"localhost", true},
+            std::pair{"nonexistent.invalid", false}}) {
+        Resolver::Instance().ResolveInLoop(
+            loop, host,
+            [&, host, expect_success](std::optional<in_addr> addr) {
+              on_done(host, expect_success, addr);
+            });
+      }
+    }
+    loop.Loop();
+  }
+
+  // a loop destroyed right after cancelling its query is never reached
+  void check_cancel() {
+    Resolver& resolver = Resolver::Instance();
+    bool is_called = false;
+    {
+      EventLoop loop;
+      Resolver::QueryID id = resolver.ResolveInLoop(
+          loop, "cancelled.invalid",
+          [&](std::optional<in_addr>) { is_called = true; });
+      if (id == 0) {
+        printf("uncached name is answered inline\n");
+        exit(1);
+      }
+      resolver.Cancel(id);
+    }
+    // answered once the lookup of the cancelled query is done, the worker
+    // may still hold the promise after the wait returns
+    auto done = std::make_shared<std::promise<void>>();
+    std::future<void> future = done->get_future();
+    resolver.ResolveAsync("cancelled.invalid",
+                          [done](std::optional<in_addr>) { done->set_value(); });
+    future.wait();
+    if (is_called) {
+      printf("cancelled query is answered\n");
+      exit(1);
+    }
+    printf("cancelled query is dropped\n");
+  }
+
+  void measure_cached() {
+    Resolver& resolver = Resolver::Instance();
+    if (!resolver.ResolveCached("localhost") ||
+        resolver.ResolveCached("nonexistent.invalid")) {
+      printf("names are not cached\n");
+      exit(1);
+    }
+    constexpr int n = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+      resolver.ResolveCached(i % 2 ? "localhost" : "127.0.0.1");
+    }
+    auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    char ip[INET_ADDRSTRLEN] = {};
+    in_addr addr = *resolver.ResolveCached("localhost");
+    ::inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    printf("localhost=%s, cached lookup costs %ld ns\n", ip, cost / n);
+  }
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<4, 100>{}.run();
+}
@@ -0,0 +1,64 @@
+#include <signal.h>
+
+#include <thread>
+#include <vector>
+
+#include "net/poller_test.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+// client and server share the fd space, so the accepted fds cross
+// FD_SETSIZE halfway; connections beyond it must be dropped while the ones
+// below keep being served
+template <uint64_t timeout_millsec, std::size_t connection_num>
+class Tester {
+ public:
+  void run() {
+    auto server = std::make_unique<TCPServer>("localhost", port_);
+    std::jthread t{[&] {
+      PollerTCPServer<PollerSelect>{std::move(server), timeout_millsec,
+                                    {.echo = true}};
+    }};
+    std::vector<std::unique_ptr<TCPConnection>> connections;
+    std::size_t served = 0;
+    std::size_t dropped = 0;
+    for (std::size_t i = 0; i < connection_num; ++i) {
+      TCPClient client{"localhost", port_};
+      auto connection = client.Connect();
+      if (!connection) {
+        exit(1);
+      }
+      socket_set_recv_timeout(connection->FD(), 1000);
+      ping(*connection) ? ++served : ++dropped;
+      connections.emplace_back(std::move(connection));
+    }
+    if (dropped == 0 || !ping(*connections.front())) {
+      printf("select server is not protected beyond FD_SETSIZE\n");
+      exit(1);
+    }
+    printf("%zu connections served, %zu dropped beyond FD_SETSIZE=%d\n",
+           served, dropped, FD_SETSIZE);
+  }
+
+ private:
+  bool ping(TCPConnection& connection) {
+    char buf[sizeof(ping_msg_)];
+    connection.SendAll(ping_msg_.data(), ping_msg_.size());
+    return connection.Recv(buf, sizeof(buf)) ==
+           static_cast<int>(ping_msg_.size());
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 600>{}.run();
+}
@@ -0,0 +1,118 @@
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "net/socket_utils.h"
+#include "net/udp_connection.h"
+
+namespace jc {
+
+template <uint64_t timeout_millsec, std::size_t msg_len, uint16_t gso_segments>
+class Tester {
+ public:
+  void run() {
+    is_running_ = true;
+    t_server_ = std::jthread{&Tester::run_server, this};
+    t_client_ = std::jthread{&Tester::run_client, this};
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_millsec));
+    is_running_ = false;
+    t_server_.join();
+    t_client_.join();
+    printf("client sent %lu datagrams in %lu syscalls\n", sent_datagrams_.load(),
+           send_calls_.load());
+    printf("server recv %lu datagrams in %lu syscalls, %lu coalesced by gro\n",
+           recv_datagrams_, recv_calls_, coalesced_msgs_);
+    if (recv_datagrams_ == 0) {
+      exit(1);
+    }
+  }
+
+ private:
+  void run_server() {
+    UDPConnection connection{IPAddr{"localhost", port_}};
+    if (!connection.EnableGRO()) {
+      printf("udp gro is not supported, receive datagrams one by one\n");
+    }
+    socket_set_recv_timeout(connection.FD(), 100);
+    std::size_t n = UDPConnection::max_batch_size_;
+    std::vector<char> bufs(n * 65536);
+    std::vector<UDPMessage> msgs(n);
+    while (is_running_) {
+      for (std::size_t i = 0; i < n; ++i) {
+        msgs[i] = {.data = bufs.data() + i * 65536, .len = 65536};
+      }
+      int res = connection.RecvBatch(msgs.data(), n);
+      if (res <= 0) {
+        continue;
+      }
+      ++recv_calls_;
+      for (int i = 0; i < res; ++i) {
+        if (msgs[i].segment_size == 0) {
+          ++recv_datagrams_;
+          continue;
+        }
+        ++coalesced_msgs_;
+        recv_datagrams_ +=
+            (msgs[i].len + msgs[i].segment_size - 1) / msgs[i].segment_size;
+      }
+      if (recv_calls_ % 10000 == 0) {
+        printf("server[%s] recv_calls=%lu, datagrams=%lu, last batch=%d\n",
+               connection.LocalAddr().IPPort().c_str(), recv_calls_,
+               recv_datagrams_, res);
+      }
+    }
+  }
+
+  void run_client() {
+    UDPConnection connection{IPAddr{"localhost", 0}, IPAddr{"localhost", port_},
+                             "lo"};
+    std::size_t n = UDPConnection::max_batch_size_;
+    std::vector<char> buf(msg_len * gso_segments, 'x');
+    // plain batches and gso batches take turns, every message of a gso
+    // batch carries gso_segments datagrams
+    std::vector<UDPMessage> plain_msgs(n);
+    std::vector<UDPMessage> gso_msgs(n / gso_segments);
+    for (auto& msg : plain_msgs) {
+      msg = {.data = buf.data(), .len = msg_len};
+    }
+    for (auto& msg : gso_msgs) {
+      msg = {.data = buf.data(),
+             .len = buf.size(),
+             .segment_size = static_cast<uint16_t>(msg_len)};
+    }
+    bool use_gso = false;
+    while (is_running_) {
+      auto& msgs = use_gso ? gso_msgs : plain_msgs;
+      int res = connection.SendBatch(msgs.data(), msgs.size());
+      if (res == -1) {
+        printf("failed to send batch, errno=%d\n", errno);
+        exit(1);
+      }
+      ++send_calls_;
+      sent_datagrams_ += use_gso ? res * gso_segments : res;
+      use_gso = !use_gso;
+    }
+  }
+
+ private:
+  const uint16_t port_ = get_free_port();
+  std::atomic<bool> is_running_ = false;
+  std::atomic<uint64_t> sent_datagrams_ = 0;
+  std::atomic<uint64_t> send_calls_ = 0;
+  uint64_t recv_datagrams_ = 0;
+  uint64_t recv_calls_ = 0;
+  uint64_t coalesced_msgs_ = 0;
+  std::jthread t_server_;
+  std::jthread t_client_;
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000, 1024, 16>{}.run();
+}
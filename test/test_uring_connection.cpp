@@ -0,0 +1,104 @@
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "net/poller_test.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+
+namespace jc {
+
+template <uint64_t timeout_millsec>
+class Tester {
+ public:
+  // the client stops a while before the server times out, a connect
+  // attempted after the server is gone would fail the test
+  void run() {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(timeout_millsec - 500);
+    // bound here so the client never connects before the port listens
+    auto listener = std::make_unique<TCPServer>("localhost", port_);
+    std::jthread server{[&] {
+      PollerTCPServer<PollerUring>{std::move(listener), timeout_millsec};
+    }};
+    check_fd_exhaustion();
+    run_client(deadline);
+  }
+
+ private:
+  // with the fd table full the multishot accept keeps failing on EMFILE, the
+  // server must retry at a slow pace instead of spinning, and serve the
+  // connection once fds are free again
+  void check_fd_exhaustion() {
+    TCPClient client{"localhost", port_, "localhost", get_free_port()};
+    std::vector<int> fillers;
+    for (int fd = ::dup(0); fd != -1; fd = ::dup(0)) {
+      fillers.push_back(fd);
+    }
+    auto connection = client.Connect();
+    if (!connection) {
+      exit(1);
+    }
+    timespec start{};
+    timespec end{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+    for (int fd : fillers) {
+      ::close(fd);
+    }
+    const int64_t cpu_millsec = (end.tv_sec - start.tv_sec) * 1000 +
+                                (end.tv_nsec - start.tv_nsec) / 1000000;
+    printf("cpu while accept failed on EMFILE: %ld ms of 500 ms\n",
+           static_cast<long>(cpu_millsec));
+    if (cpu_millsec > 250) {
+      printf("accept spins on EMFILE\n");
+      exit(1);
+    }
+    std::string msg = std::string{ping_msg_} + "0";
+    connection->Send(const_cast<char*>(msg.c_str()), msg.size());
+    if (connection->Recv(buf_, sizeof(buf_)) <= 0) {
+      printf("connection accepted after EMFILE got no reply\n");
+      exit(1);
+    }
+  }
+
+  void run_client(std::chrono::steady_clock::time_point deadline) {
+    int i = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+      TCPClient client{"localhost", port_, "localhost", get_free_port()};
+      auto connection = client.Connect();
+      if (!connection) {
+        exit(1);
+      }
+      ++i;
+      std::string msg = std::string{ping_msg_} + std::to_string(i);
+      connection->Send(const_cast<char*>(msg.c_str()), msg.size());
+      int len = connection->Recv(buf_, sizeof(buf_));
+      if (len <= 0) {
+        printf("connection[%d] got no reply\n", i);
+        exit(1);
+      }
+      printf("connection[%d] client[%s] recv from server[%s], msg[%d]=%s\n", i,
+             connection->LocalAddr().IPPort().c_str(),
+             connection->PeerAddr().IPPort().c_str(), len, buf_);
+    }
+  }
+
+ private:
+  static constexpr std::string_view ping_msg_ = "ping";
+  char buf_[1024] = {};
+  const uint16_t port_ = get_free_port();
+};
+
+}  // namespace jc
+
+int main() {
+  ::signal(SIGCHLD, SIG_IGN);
+  ::signal(SIGPIPE, SIG_IGN);
+  jc::Tester<3000>{}.run();
+}